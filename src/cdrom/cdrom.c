@@ -29,6 +29,7 @@
 #include <86box/plat.h>
 #include <86box/scsi_device.h>
 #include <86box/sound.h>
+#include <86box/ringbuf.h>
 
 
 /* The addresses sent from the guest are absolute, ie. a LBA of 0 corresponds to a MSF of 00:00:00. Otherwise, the counter displayed by the guest is wrong:
@@ -43,6 +44,8 @@
 #define MIN_SEEK		2000
 #define MAX_SEEK	      333333
 
+#define CD_AUDIO_RING		32	/* Audio sectors read ahead of the play position. */
+
 #define CD_BCD(x)      	(((x) % 10) | (((x) / 10) << 4))
 #define CD_DCB(x) 	((((x) & 0xf0) >> 4) * 10 + ((x) & 0x0f))
 
@@ -89,6 +92,22 @@ typedef union {
 #pragma pack(pop)
 
 
+/* An audio sector read ahead by the CD audio reader thread. */
+typedef struct {
+    uint32_t	lba, play_seq;
+    uint8_t	data[RAW_SECTOR_SIZE];
+} cd_audio_sector_t;
+
+typedef struct {
+    ringbuf_t	ring;
+    uint32_t	play_seq,		/* Bumped by every play command. */
+		req_lba, req_seq,	/* Where the consumer wants the reader to go. */
+		seen_seq, next_lba;	/* Reader thread only. */
+    uint32_t	hits, underruns;
+} cd_audio_t;
+
+
+static cd_audio_t	cd_audio[CDROM_NUM];
 static int		cdrom_sector_size;
 static uint8_t		raw_buffer[2856];	/* Needs to be the same size as sector_buffer_t in the structs. */
 static uint8_t		extra_buffer[296];
@@ -238,6 +257,94 @@ cdrom_seek(cdrom_t *dev, uint32_t pos)
 }
 
 
+/* Called from the CD audio reader thread, keeps the drive's ring of
+   audio sectors filled ahead of the play position. */
+void
+cdrom_audio_prefetch(cdrom_t *dev)
+{
+    cd_audio_t *a = &cd_audio[dev->id];
+    const cdrom_ops_t *ops = dev->ops;
+    cd_audio_sector_t *s;
+    uint32_t seq, play_seq;
+
+    if ((a->ring.buf == NULL) || (ops == NULL))
+	return;
+
+    seq = __atomic_load_n(&a->req_seq, __ATOMIC_ACQUIRE);
+    if (seq != a->seen_seq) {
+	a->seen_seq = seq;
+	a->next_lba = __atomic_load_n(&a->req_lba, __ATOMIC_RELAXED);
+    }
+
+    /* Nothing asked for yet. */
+    if (a->seen_seq == 0)
+	return;
+
+    play_seq = __atomic_load_n(&a->play_seq, __ATOMIC_ACQUIRE);
+
+    while ((dev->cd_status == CD_STATUS_PLAYING) && (a->next_lba < dev->cd_end)) {
+	s = (cd_audio_sector_t *) ringbuf_write_ptr(&a->ring);
+	if (s == NULL)
+		break;
+
+	if (!ops->read_sector(dev, CD_READ_AUDIO, s->data, a->next_lba))
+		break;
+
+	s->lba = a->next_lba++;
+	s->play_seq = play_seq;
+	ringbuf_write_commit(&a->ring);
+    }
+}
+
+
+/* Get an audio sector, from the read-ahead ring if the reader thread
+   already has it, otherwise straight from the image. */
+static int
+cdrom_audio_read(cdrom_t *dev, uint8_t *buffer, uint32_t lba)
+{
+    cd_audio_t *a = &cd_audio[dev->id];
+    cd_audio_sector_t *s;
+    uint32_t play_seq;
+
+    if (a->ring.buf == NULL)
+	return dev->ops->read_sector(dev, CD_READ_AUDIO, buffer, lba);
+
+    play_seq = __atomic_load_n(&a->play_seq, __ATOMIC_ACQUIRE);
+
+    /* Anything not at the play position is stale. */
+    while ((s = (cd_audio_sector_t *) ringbuf_read_ptr(&a->ring)) != NULL) {
+	if ((s->lba == lba) && (s->play_seq == play_seq)) {
+		memcpy(buffer, s->data, RAW_SECTOR_SIZE);
+		ringbuf_read_commit(&a->ring);
+		a->hits++;
+		return 1;
+	}
+	ringbuf_read_commit(&a->ring);
+    }
+
+    a->underruns++;
+
+    /* The ring held nothing usable, so move the reader right after this sector. */
+    __atomic_store_n(&a->req_lba, lba + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&a->req_seq, a->req_seq + 1, __ATOMIC_RELEASE);
+
+    return dev->ops->read_sector(dev, CD_READ_AUDIO, buffer, lba);
+}
+
+
+static void
+cdrom_audio_new_play(cdrom_t *dev)
+{
+    cd_audio_t *a = &cd_audio[dev->id];
+
+    __atomic_store_n(&a->play_seq, a->play_seq + 1, __ATOMIC_RELEASE);
+
+    /* Send the reader to the new play position right away. */
+    __atomic_store_n(&a->req_lba, dev->seek_pos, __ATOMIC_RELAXED);
+    __atomic_store_n(&a->req_seq, a->req_seq + 1, __ATOMIC_RELEASE);
+}
+
+
 int
 cdrom_audio_callback(cdrom_t *dev, int16_t *output, int len)
 {
@@ -253,9 +360,8 @@ cdrom_audio_callback(cdrom_t *dev, int16_t *output, int len)
 
     while (dev->cd_buflen < len) {
 	if (dev->seek_pos < dev->cd_end) {
-		if (dev->ops->read_sector(dev, CD_READ_AUDIO,
-					  (uint8_t *) &(dev->cd_buffer[dev->cd_buflen]),
-					  dev->seek_pos)) {
+		if (cdrom_audio_read(dev, (uint8_t *) &(dev->cd_buffer[dev->cd_buflen]),
+				     dev->seek_pos)) {
 			cdrom_log("CD-ROM %i: Read LBA %08X successful\n", dev->id, dev->seek_pos);
 			dev->seek_pos++;
 			dev->cd_buflen += (RAW_SECTOR_SIZE / 2);
@@ -269,7 +375,8 @@ cdrom_audio_callback(cdrom_t *dev, int16_t *output, int len)
 			ret = 0;
 		}
 	} else {
-		cdrom_log("CD-ROM %i: Playing completed\n", dev->id);
+		cdrom_log("CD-ROM %i: Playing completed (%i sectors read ahead, %i underruns)\n",
+			  dev->id, cd_audio[dev->id].hits, cd_audio[dev->id].underruns);
 		memset(&dev->cd_buffer[dev->cd_buflen],
 		       0x00, (BUF_SIZE - dev->cd_buflen) * 2);
 		dev->cd_status = CD_STATUS_PLAYING_COMPLETED;
@@ -345,6 +452,7 @@ cdrom_audio_play(cdrom_t *dev, uint32_t pos, uint32_t len, int ismsf)
     dev->cd_end = len;
     dev->cd_status = CD_STATUS_PLAYING;
     dev->cd_buflen = 0;
+    cdrom_audio_new_play(dev);
 
     return 1;
 }
@@ -378,6 +486,7 @@ cdrom_audio_track_search(cdrom_t *dev, uint32_t pos, int type, uint8_t playbit)
     dev->seek_pos = pos;
     dev->noplay = !playbit;
     dev->cd_status = playbit ? CD_STATUS_PLAYING : CD_STATUS_PAUSED;
+    cdrom_audio_new_play(dev);
     return 1;
 }
 
@@ -413,6 +522,7 @@ cdrom_toshiba_audio_play(cdrom_t *dev, uint32_t pos, int type)
     
     dev->cd_end = pos;
     dev->cd_buflen = 0;
+    cdrom_audio_new_play(dev);
     return 1;
 }
 
@@ -990,6 +1100,30 @@ read_mode2_xa_form2(cdrom_t *dev, int cdrom_sector_flags, uint32_t lba, uint32_t
 }
 
 
+/* Read a run of plain 2048-byte Mode 1 sectors with a single call to the
+   backend, which is what READ (10)/(12) ask for nearly all the time.
+   Returns 0 if the run holds anything else, so the caller can go through
+   cdrom_readsector_raw() one sector at a time instead. */
+int
+cdrom_readsectors_cooked(cdrom_t *dev, uint8_t *buffer, uint32_t lba, int num)
+{
+    int i;
+
+    if ((dev->cd_status == CD_STATUS_EMPTY) || (dev->ops == NULL) ||
+	(dev->ops->read_sectors == NULL) || (num < 2))
+	return 0;
+
+    if (dev->ops->track_type) {
+	for (i = 0; i < num; i++) {
+		if (dev->ops->track_type(dev, lba + i) != 0)
+			return 0;
+	}
+    }
+
+    return dev->ops->read_sectors(dev, CD_READ_DATA, buffer, lba, num);
+}
+
+
 int
 cdrom_readsector_raw(cdrom_t *dev, uint8_t *buffer, int sector, int ismsf, int cdrom_sector_type,
 		     int cdrom_sector_flags, int *len)
@@ -1169,6 +1303,10 @@ cdrom_hard_reset(void)
 
 		cdrom_drive_reset(dev);
 
+		if (cd_audio[i].ring.buf == NULL)
+			ringbuf_init(&cd_audio[i].ring, sizeof(cd_audio_sector_t), CD_AUDIO_RING);
+		cd_audio[i].hits = cd_audio[i].underruns = 0;
+
 		switch(dev->bus_type) {
 			case CDROM_BUS_ATAPI:
 			case CDROM_BUS_SCSI:
@@ -1211,6 +1349,10 @@ cdrom_close(void)
 	dev->ops = NULL;
 	dev->priv = NULL;
 
+	/* The CD audio threads are stopped by now. */
+	ringbuf_close(&cd_audio[i].ring);
+	memset(&cd_audio[i], 0x00, sizeof(cd_audio_t));
+
 	cdrom_drive_reset(dev);
     }
 }
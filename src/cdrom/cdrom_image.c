@@ -192,6 +192,22 @@ image_read_sector(struct cdrom *dev, int type, uint8_t *b, uint32_t lba)
 }
 
 
+static int
+image_read_sectors(struct cdrom *dev, int type, uint8_t *b, uint32_t lba, uint32_t num)
+{
+    cd_img_t *img = (cd_img_t *)dev->image;
+
+    switch (type) {
+	case CD_READ_DATA:
+		return cdi_read_sectors(img, b, 0, lba, num);
+	case CD_READ_AUDIO:
+		return cdi_read_sectors(img, b, 1, lba, num);
+	default:
+		return 0;
+    }
+}
+
+
 static int
 image_track_type(cdrom_t *dev, uint32_t lba)
 {
@@ -233,6 +249,7 @@ static const cdrom_ops_t cdrom_image_ops = {
     image_get_subchannel,
     image_sector_size,
     image_read_sector,
+    image_read_sectors,
     image_track_type,
     image_exit
 };
@@ -270,6 +287,8 @@ cdrom_image_open(cdrom_t *dev, const wchar_t *fn)
     if (!cdi_set_device(img, fn))
 	return image_open_abort(dev);
 
+    cdi_set_readahead(img, dev->readahead);
+
     /* All good, reset state. */
     if (! wcscasecmp(plat_get_extension((wchar_t *) fn), L"ISO"))
 	dev->cd_status = CD_STATUS_DATA_ONLY;
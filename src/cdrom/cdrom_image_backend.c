@@ -27,10 +27,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <ctype.h>
-#ifdef _WIN32
-# include <string.h>
-#else
+#ifndef _WIN32
 # include <libgen.h>
 #endif
 #include <wchar.h>
@@ -45,6 +44,7 @@
 #define MAX_LINE_LENGTH		512
 #define MAX_FILENAME_LENGTH	256
 #define CROSS_LEN		512
+#define MAX_SECTOR_SIZE		2448
 
 
 static char	temp_keyword[1024];
@@ -148,7 +148,7 @@ bin_init(const wchar_t *filename, int *error)
 	return NULL;
     }
 
-    memset(tf->fn, 0x00, sizeof(tf->fn));
+    memset(tf, 0x00, sizeof(track_file_t));
     if (wcslen(filename) <= 260)
 	wcscpy(tf->fn, filename);
     else
@@ -224,6 +224,10 @@ cdi_clear_tracks(cd_img_t *cdi)
     free(cdi->tracks);
     cdi->tracks = NULL;
 
+    /* Anything cached refers to the old tracks. */
+    cdi->last_track = 0;
+    cdi->ra_count = 0;
+
     /* Mark that there's no tracks. */
     cdi->tracks_num = 0;
 }
@@ -233,13 +237,53 @@ void
 cdi_close(cd_img_t *cdi)
 {
     cdi_clear_tracks(cdi);
+
+    if (cdi->ra_buf != NULL)
+	free(cdi->ra_buf);
+    if (cdi->ra_mutex != NULL)
+	thread_close_mutex(cdi->ra_mutex);
+
     free(cdi);
 }
 
 
+/* Sets the number of sectors read ahead into the cache on a miss. */
+void
+cdi_set_readahead(cd_img_t *cdi, uint32_t sectors)
+{
+    if (sectors > CDI_READAHEAD_MAX)
+	sectors = CDI_READAHEAD_MAX;
+
+    if (cdi->ra_mutex == NULL)
+	cdi->ra_mutex = thread_create_mutex();
+
+    thread_wait_mutex(cdi->ra_mutex);
+
+    if (cdi->ra_buf != NULL) {
+	free(cdi->ra_buf);
+	cdi->ra_buf = NULL;
+    }
+    cdi->ra_count = 0;
+    cdi->ra_size = 0;
+
+    /* A cache of a single sector is no better than a direct read. */
+    if (sectors > 1) {
+	cdi->ra_buf = (uint8_t *) malloc(sectors * MAX_SECTOR_SIZE);
+	if (cdi->ra_buf != NULL)
+		cdi->ra_size = sectors;
+    }
+
+    thread_release_mutex(cdi->ra_mutex);
+}
+
+
 int
 cdi_set_device(cd_img_t *cdi, const wchar_t *path)
 {
+    /* Compressed images must not be mistaken for an ISO. */
+    if (! wcscasecmp(plat_get_extension((wchar_t *) path), L"CHD"))
+	return cdi_load_chd(cdi, path);
+
     if (cdi_load_cue(cdi, path))
 	return 1;
 
@@ -312,8 +356,8 @@ cdi_get_audio_track_info_lba(cd_img_t *cdi, int end, int track, int *track_num,
 }
 
 
-int
-cdi_get_track(cd_img_t *cdi, uint32_t sector)
+static int
+cdi_find_track(cd_img_t *cdi, uint32_t sector)
 {
     int i;
     track_t *cur, *next;
@@ -322,19 +366,47 @@ cdi_get_track(cd_img_t *cdi, uint32_t sector)
     if (cdi->tracks_num < 2)
 	return -1;
 
+    /* Reads are mostly sequential, so try the last matched track first. */
+    i = cdi->last_track;
+    if ((i >= 0) && (i < (cdi->tracks_num - 1))) {
+	cur = &cdi->tracks[i];
+	next = &cdi->tracks[i + 1];
+	if ((cur->start <= sector) && (sector < next->start))
+		return cur->number;
+    }
+
     /* This has a problem - the code skips the last track, which is
        lead out - is that correct? */
     for (i = 0; i < (cdi->tracks_num - 1); i++) {
 	cur = &cdi->tracks[i];
 	next = &cdi->tracks[i + 1];
-	if ((cur->start <= sector) && (sector < next->start))
+	if ((cur->start <= sector) && (sector < next->start)) {
+		cdi->last_track = i;
 		return cur->number;
+	}
     }
 
     return -1;
 }
 
 
+int
+cdi_get_track(cd_img_t *cdi, uint32_t sector)
+{
+    int ret;
+
+    if (cdi->ra_mutex == NULL)
+	return cdi_find_track(cdi, sector);
+
+    /* The last matched track is shared with the CD audio reader thread. */
+    thread_wait_mutex(cdi->ra_mutex);
+    ret = cdi_find_track(cdi, sector);
+    thread_release_mutex(cdi->ra_mutex);
+
+    return ret;
+}
+
+
 /* TODO: See if track start is adjusted by 150 or not. */
 int
 cdi_get_audio_sub(cd_img_t *cdi, uint32_t sector, uint8_t *attr, uint8_t *track, uint8_t *index, TMSF *rel_pos, TMSF *abs_pos)
@@ -359,12 +431,60 @@ cdi_get_audio_sub(cd_img_t *cdi, uint32_t sector, uint8_t *attr, uint8_t *track,
 }
 
 
+/* Read part of a single sector from the track file, going through the
+   read-ahead cache. On a miss, the cache is refilled with a run of whole
+   sectors starting at the requested one using a single file read. */
+static int
+cdi_read_track(cd_img_t *cdi, int track, uint8_t *buffer, uint64_t sect, uint64_t offset, size_t length)
+{
+    track_t *trk = &cdi->tracks[track];
+    uint64_t seek = trk->skip + ((sect - trk->start) * trk->sector_size);
+    uint64_t count, end;
+    int cached, ret = 1;
+
+    if (cdi->ra_mutex == NULL)
+	return trk->file->read(trk->file, buffer, seek + offset, length);
+
+    /* The CD audio reader thread shares the image with the emulation thread. */
+    thread_wait_mutex(cdi->ra_mutex);
+
+    cached = ((offset + length) <= trk->sector_size);
+
+    if (cached && ((cdi->ra_count == 0) || (cdi->ra_track != track) ||
+	(sect < cdi->ra_start) || (sect >= (cdi->ra_start + cdi->ra_count)))) {
+	cdi->ra_count = 0;
+
+	count = cdi->ra_size;
+	end = trk->start + trk->length;
+	if ((sect + count) > end)
+		count = (sect < end) ? (end - sect) : 0;
+
+	if ((count > 1) && trk->file->read(trk->file, cdi->ra_buf, seek, count * trk->sector_size)) {
+		cdi->ra_track = track;
+		cdi->ra_start = (uint32_t) sect;
+		cdi->ra_count = (uint32_t) count;
+	}
+    }
+
+    if (cached && (cdi->ra_count != 0))
+	memcpy(buffer, cdi->ra_buf + ((sect - cdi->ra_start) * trk->sector_size) + offset, length);
+    else {
+	/* Nothing to read ahead, or a short read at the end of the file. */
+	ret = trk->file->read(trk->file, buffer, seek + offset, length);
+    }
+
+    thread_release_mutex(cdi->ra_mutex);
+
+    return ret;
+}
+
+
 int
 cdi_read_sector(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector)
 {
     size_t length;
     int track = cdi_get_track(cdi, sector) - 1;
-    uint64_t sect = (uint64_t) sector, seek;
+    uint64_t sect = (uint64_t) sector;
     track_t *trk;
     int track_is_raw, ret;
     int raw_size, cooked_size;
@@ -377,8 +497,6 @@ cdi_read_sector(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector)
     trk = &cdi->tracks[track];
     track_is_raw = ((trk->sector_size == RAW_SECTOR_SIZE) || (trk->sector_size == 2448));
 
-    seek = trk->skip + ((sect - trk->start) * trk->sector_size);
-
     if (track_is_raw)
 	raw_size = trk->sector_size;
     else
@@ -401,7 +519,8 @@ cdi_read_sector(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector)
 
     if (raw && !track_is_raw) {
 	memset(buffer, 0x00, 2448);
-    	ret = trk->file->read(trk->file, buffer + offset, seek, length);
+	/* Only the user data is present in the image. */
+	ret = cdi_read_track(cdi, track, buffer + offset, sect, 0ULL, cooked_size);
 	if (!ret)
 		return 0;
 	/* Construct the rest of the raw sector. */
@@ -415,35 +534,63 @@ cdi_read_sector(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector)
 	buffer[15] = trk->mode2 ? 2 : 1;	/* Data, should reflect the actual sector type. */
 	return 1;
     } else if (!raw && track_is_raw)
-    	return trk->file->read(trk->file, buffer, seek + offset, length);
+	return cdi_read_track(cdi, track, buffer, sect, offset, length);
     else
-    	return trk->file->read(trk->file, buffer, seek, length);
+	return cdi_read_track(cdi, track, buffer, sect, 0ULL, length);
 }
 
 
 int
 cdi_read_sectors(cd_img_t *cdi, uint8_t *buffer, int raw, uint32_t sector, uint32_t num)
 {
-    int sector_size, success = 1;
-    uint8_t buf_len, *buf;
-    uint32_t i;
+    uint8_t temp[MAX_SECTOR_SIZE];
+    int sector_size, track, success = 1;
+    uint64_t seek, end;
+    uint32_t i, span;
+    track_t *trk;
 
     /* TODO: This fails to account for Mode 2. Shouldn't we have a function 
 	     to get sector size? */
     sector_size = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
-    buf_len = num * sector_size;
-    buf = (uint8_t *) malloc(buf_len * sizeof(uint8_t));
 
-    for (i = 0; i < num; i++) {
-	success = cdi_read_sector(cdi, &buf[i * sector_size], raw, sector + i);
+    for (i = 0; i < num; i += span) {
+	track = cdi_get_track(cdi, sector + i) - 1;
+	if (track < 0)
+		return 0;
+
+	trk = &cdi->tracks[track];
+
+	/* Number of requested sectors left in this track. */
+	span = num - i;
+	end = trk->start + trk->length;
+	if (end <= (sector + i))
+		span = 1;
+	else if ((end - (sector + i)) < span)
+		span = (uint32_t) (end - (sector + i));
+
+	if (trk->sector_size == sector_size) {
+		/* The image already holds the sectors in the requested
+		   format, so read the whole span in one go. */
+		seek = trk->skip + (((uint64_t) (sector + i) - trk->start) * trk->sector_size);
+		if (cdi->ra_mutex != NULL)
+			thread_wait_mutex(cdi->ra_mutex);
+		success = trk->file->read(trk->file, &buffer[i * sector_size], seek,
+					  ((size_t) span) * sector_size);
+		if (cdi->ra_mutex != NULL)
+			thread_release_mutex(cdi->ra_mutex);
+		if (success)
+			continue;
+
+		/* Possibly a padded last sector, fall back to single sectors. */
+	}
+
+	span = 1;
+	success = cdi_read_sector(cdi, temp, raw, sector + i);
 	if (!success)
 		break;
+	memcpy(&buffer[i * sector_size], temp, sector_size);
     }
 
-    memcpy((void *) buffer, buf, buf_len);
-    free(buf);
-    buf = NULL;
-
     return success;
 }
 
@@ -455,6 +602,7 @@ cdi_read_sector_sub(cd_img_t *cdi, uint8_t *buffer, uint32_t sector)
     int track = cdi_get_track(cdi, sector) - 1;
     track_t *trk;
     uint64_t s = (uint64_t) sector, seek;
+    int ret;
 
     if (track < 0)
 	return 0;
@@ -464,7 +612,14 @@ cdi_read_sector_sub(cd_img_t *cdi, uint8_t *buffer, uint32_t sector)
     if (trk->sector_size != 2448)
 	return 0;
 
-    return trk->file->read(trk->file, buffer, seek, 2448);
+    if (cdi->ra_mutex == NULL)
+	return trk->file->read(trk->file, buffer, seek, 2448);
+
+    thread_wait_mutex(cdi->ra_mutex);
+    ret = trk->file->read(trk->file, buffer, seek, 2448);
+    thread_release_mutex(cdi->ra_mutex);
+
+    return ret;
 }
 
 
@@ -607,6 +762,46 @@ cdi_load_iso(cd_img_t *cdi, const wchar_t *filename)
 }
 
 
+int
+cdi_load_chd(cd_img_t *cdi, const wchar_t *filename)
+{
+    int error, i;
+    track_file_t *tf;
+    track_t trk;
+
+    cdi->tracks = NULL;
+    cdi->tracks_num = 0;
+
+    tf = chd_init(filename, &error);
+    if (error)
+	return 0;
+
+    memset(&trk, 0, sizeof(track_t));
+    for (i = 0; chd_get_track(tf, i, &trk); i++)
+	cdi_track_push_back(cdi, &trk);
+
+    /* Not a CD image, or no track metadata we understand. */
+    if (cdi->tracks_num == 0) {
+#ifdef ENABLE_CDROM_IMAGE_BACKEND_LOG
+	cdrom_image_backend_log("CHD: no CD tracks in '%ls'\n", filename);
+#endif
+	tf->close(tf);
+	return 0;
+    }
+
+    /* Lead out track. */
+    trk.number++;
+    trk.track_number = 0xAA;
+    trk.attr = 0x16;
+    trk.start += trk.length;
+    trk.length = 0;
+    trk.file = NULL;
+    cdi_track_push_back(cdi, &trk);
+
+    return 1;
+}
+
+
 static int
 cdi_cue_get_buffer(char *str, char **line, int up)
 {
@@ -0,0 +1,1113 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		CD-ROM image file handling module, compressed (CHD version 5)
+ *		image support.
+ *
+ *		The image is split into hunks which are compressed on their
+ *		own, so any sector can be read by decompressing the hunk that
+ *		holds it. Decompressed hunks are kept in a small LRU cache,
+ *		and a background thread decompresses the next few hunks ahead
+ *		of the guest when it is reading sequentially.
+ *
+ *		Only the deflate based codecs ("zlib" and "cdzl") are
+ *		supported; create images with "chdman createcd -c cdzl".
+ */
+#define _LARGEFILE_SOURCE
+#define _LARGEFILE64_SOURCE
+#define __STDC_FORMAT_MACROS
+#include <stdarg.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+#include <zlib.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/plat.h>
+#include <86box/cdrom_image_backend.h>
+
+
+#define CHD_V5_HEADER_SIZE	124
+#define CHD_MAX_TRACKS		99
+
+#define CHD_CACHE_HUNKS		32	/* Decompressed hunks kept around. */
+#define CHD_PREFETCH_HUNKS	4	/* Hunks decompressed ahead of the guest. */
+
+#define CHD_FRAME_SIZE		2448
+#define CHD_SECTOR_DATA		2352
+#define CHD_TRACK_PADDING	4
+
+#define CHD_TAG(a, b, c, d)	((((uint32_t) (a)) << 24) | (((uint32_t) (b)) << 16) | \
+				 (((uint32_t) (c)) << 8) | ((uint32_t) (d)))
+#define CHD_CODEC_NONE		0
+#define CHD_CODEC_ZLIB		CHD_TAG('z', 'l', 'i', 'b')
+#define CHD_CODEC_CDZL		CHD_TAG('c', 'd', 'z', 'l')
+#define CHD_META_TRACK		CHD_TAG('C', 'H', 'T', 'R')
+#define CHD_META_TRACK2		CHD_TAG('C', 'H', 'T', '2')
+
+
+/* Hunk map entry types, including the pseudo-types of the compressed map. */
+enum {
+    CHD_COMP_TYPE_0 = 0,
+    CHD_COMP_TYPE_1,
+    CHD_COMP_TYPE_2,
+    CHD_COMP_TYPE_3,
+    CHD_COMP_NONE,
+    CHD_COMP_SELF,
+    CHD_COMP_PARENT,
+    CHD_COMP_RLE_SMALL,
+    CHD_COMP_RLE_LARGE,
+    CHD_COMP_SELF_0,
+    CHD_COMP_SELF_1,
+    CHD_COMP_PARENT_SELF,
+    CHD_COMP_PARENT_0,
+    CHD_COMP_PARENT_1
+};
+
+
+typedef struct {
+    uint8_t	type;
+    uint32_t	length;
+    uint64_t	offset;
+} chd_map_t;
+
+typedef struct {
+    int32_t	hunk;
+    uint32_t	stamp;
+    uint8_t	*data;
+} chd_slot_t;
+
+/* Decompression context, one per thread that decompresses hunks. */
+typedef struct {
+    FILE	*file;
+    z_stream	z;
+    int		z_init;
+    uint8_t	*comp, *temp,
+		*data;
+} chd_ctx_t;
+
+typedef struct {
+    int		number, attr, sector_size,
+		mode2, form, swap;
+    uint32_t	frames,		/* Frames stored, including the pregap if present. */
+		pregap, pregap_in_file,
+		start,		/* LBA of index 1. */
+		frame;		/* First stored frame. */
+    uint64_t	virt;
+} chd_track_t;
+
+typedef struct {
+    uint32_t	hunkbytes, unitbytes,
+		hunkcount, compressors[4];
+    uint64_t	mapoffset, metaoffset;
+
+    chd_map_t	*map;
+
+    chd_ctx_t	rd, pf;
+
+    chd_slot_t	cache[CHD_CACHE_HUNKS];
+    uint32_t	stamp;
+    int32_t	last_hunk, pf_hunk;
+
+    mutex_t	*mutex;
+    thread_t	*pf_thread;
+    event_t	*pf_event;
+    volatile int pf_stop;
+
+    int		tracks_num, cur_track;
+    chd_track_t	tracks[CHD_MAX_TRACKS];
+    uint64_t	virt_len;
+} chd_t;
+
+/* MSB-first bit reader for the compressed hunk map. */
+typedef struct {
+    const uint8_t *data;
+    uint32_t	len, pos,
+		buffer;
+    int		bits;
+} chd_bits_t;
+
+/* Huffman decoder for the compressed hunk map, 16 codes of up to 8 bits. */
+typedef struct {
+    uint8_t	numbits[16];
+    uint32_t	code[16];
+    uint16_t	lookup[256];
+} chd_huff_t;
+
+
+static const uint8_t	chd_sync_header[12] = {
+    0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00
+};
+static uint8_t		ecc_f_lut[256], ecc_b_lut[256];
+static int		ecc_init_done = 0;
+
+
+#ifdef ENABLE_CDROM_IMAGE_CHD_LOG
+int cdrom_image_chd_do_log = ENABLE_CDROM_IMAGE_CHD_LOG;
+
+
+void
+cdrom_image_chd_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (cdrom_image_chd_do_log) {
+        va_start(ap, fmt);
+        pclog_ex(fmt, ap);
+        va_end(ap);
+    }
+}
+#else
+#define cdrom_image_chd_log(fmt, ...)
+#endif
+
+
+static uint32_t
+chd_be16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+
+static uint32_t
+chd_be24(const uint8_t *p)
+{
+    return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+
+static uint32_t
+chd_be32(const uint8_t *p)
+{
+    return (((uint32_t) p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+static uint64_t
+chd_be48(const uint8_t *p)
+{
+    return (((uint64_t) chd_be16(p)) << 32) | chd_be32(p + 2);
+}
+
+
+static uint64_t
+chd_be64(const uint8_t *p)
+{
+    return (((uint64_t) chd_be32(p)) << 32) | chd_be32(p + 4);
+}
+
+
+static int
+chd_fread(FILE *f, void *buffer, uint64_t seek, size_t count)
+{
+    if (fseeko64(f, seek, SEEK_SET) == -1)
+	return 0;
+
+    return (fread(buffer, count, 1, f) == 1);
+}
+
+
+static uint32_t
+chd_bits_peek(chd_bits_t *b, int numbits)
+{
+    if (numbits == 0)
+	return 0;
+
+    if (numbits > b->bits) {
+	while (b->bits <= 24) {
+		if (b->pos < b->len)
+			b->buffer |= b->data[b->pos] << (24 - b->bits);
+		b->pos++;
+		b->bits += 8;
+	}
+    }
+
+    return b->buffer >> (32 - numbits);
+}
+
+
+static void
+chd_bits_remove(chd_bits_t *b, int numbits)
+{
+    b->buffer <<= numbits;
+    b->bits -= numbits;
+}
+
+
+static uint32_t
+chd_bits_read(chd_bits_t *b, int numbits)
+{
+    uint32_t ret = chd_bits_peek(b, numbits);
+
+    chd_bits_remove(b, numbits);
+
+    return ret;
+}
+
+
+/* Read the RLE-encoded code lengths and build the canonical codes. */
+static int
+chd_huff_import(chd_huff_t *h, chd_bits_t *b)
+{
+    uint32_t histo[33], start = 0, next;
+    int i, len, nodebits, rep, cur = 0;
+
+    while (cur < 16) {
+	nodebits = chd_bits_read(b, 4);
+	if (nodebits != 1)
+		h->numbits[cur++] = nodebits;
+	else {
+		/* A one is an escape, a double one is just a single one. */
+		nodebits = chd_bits_read(b, 4);
+		if (nodebits == 1)
+			h->numbits[cur++] = nodebits;
+		else {
+			rep = chd_bits_read(b, 4) + 3;
+			if ((cur + rep) > 16)
+				return 0;
+			while (rep--)
+				h->numbits[cur++] = nodebits;
+		}
+	}
+    }
+
+    memset(histo, 0x00, sizeof(histo));
+    for (i = 0; i < 16; i++) {
+	if (h->numbits[i] > 8)
+		return 0;
+	histo[h->numbits[i]]++;
+    }
+
+    for (len = 32; len > 0; len--) {
+	next = (start + histo[len]) >> 1;
+	if ((len != 1) && ((next * 2) != (start + histo[len])))
+		return 0;
+	histo[len] = start;
+	start = next;
+    }
+
+    memset(h->lookup, 0x00, sizeof(h->lookup));
+    for (i = 0; i < 16; i++) {
+	if (h->numbits[i] == 0)
+		continue;
+
+	h->code[i] = histo[h->numbits[i]]++;
+
+	/* Fill every lookup entry that starts with this code. */
+	rep = 8 - h->numbits[i];
+	for (len = (h->code[i] << rep); len < ((h->code[i] + 1) << rep); len++)
+		h->lookup[len] = (i << 5) | h->numbits[i];
+    }
+
+    return 1;
+}
+
+
+static int
+chd_huff_decode(chd_huff_t *h, chd_bits_t *b)
+{
+    uint16_t l = h->lookup[chd_bits_peek(b, 8)];
+
+    chd_bits_remove(b, l & 0x1f);
+
+    return l >> 5;
+}
+
+
+static int
+chd_load_map(chd_t *chd, FILE *f)
+{
+    uint8_t hdr[16], *comp, lastcomp = 0;
+    uint64_t curoffset, last_self = 0;
+    uint32_t i, mapbytes, repcount = 0;
+    int lengthbits, selfbits, parentbits;
+    chd_bits_t b;
+    chd_huff_t h;
+    chd_map_t *m;
+
+    chd->map = (chd_map_t *) calloc(chd->hunkcount, sizeof(chd_map_t));
+    if (chd->map == NULL)
+	return 0;
+
+    /* Uncompressed images have a plain table of hunk numbers. */
+    if (chd->compressors[0] == CHD_CODEC_NONE) {
+	comp = (uint8_t *) malloc(chd->hunkcount * 4);
+	if ((comp == NULL) || !chd_fread(f, comp, chd->mapoffset, chd->hunkcount * 4)) {
+		free(comp);
+		return 0;
+	}
+	for (i = 0; i < chd->hunkcount; i++) {
+		chd->map[i].type = CHD_COMP_NONE;
+		chd->map[i].offset = ((uint64_t) chd_be32(&comp[i * 4])) * chd->hunkbytes;
+	}
+	free(comp);
+	return 1;
+    }
+
+    if (!chd_fread(f, hdr, chd->mapoffset, sizeof(hdr)))
+	return 0;
+
+    mapbytes = chd_be32(&hdr[0]);
+    curoffset = chd_be48(&hdr[4]);
+    lengthbits = hdr[12];
+    selfbits = hdr[13];
+    parentbits = hdr[14];
+
+    comp = (uint8_t *) malloc(mapbytes);
+    if ((comp == NULL) || !chd_fread(f, comp, chd->mapoffset + sizeof(hdr), mapbytes)) {
+	free(comp);
+	return 0;
+    }
+
+    memset(&b, 0x00, sizeof(chd_bits_t));
+    b.data = comp;
+    b.len = mapbytes;
+
+    if (!chd_huff_import(&h, &b)) {
+	free(comp);
+	return 0;
+    }
+
+    /* First decode the compression types. */
+    for (i = 0; i < chd->hunkcount; i++) {
+	m = &chd->map[i];
+	if (repcount > 0) {
+		m->type = lastcomp;
+		repcount--;
+	} else {
+		m->type = chd_huff_decode(&h, &b);
+		if (m->type == CHD_COMP_RLE_SMALL) {
+			m->type = lastcomp;
+			repcount = 2 + chd_huff_decode(&h, &b);
+		} else if (m->type == CHD_COMP_RLE_LARGE) {
+			m->type = lastcomp;
+			repcount = 2 + 16 + (chd_huff_decode(&h, &b) << 4);
+			repcount += chd_huff_decode(&h, &b);
+		} else
+			lastcomp = m->type;
+	}
+    }
+
+    /* Then the lengths and offsets. */
+    for (i = 0; i < chd->hunkcount; i++) {
+	m = &chd->map[i];
+	m->offset = curoffset;
+	switch (m->type) {
+		case CHD_COMP_TYPE_0: case CHD_COMP_TYPE_1:
+		case CHD_COMP_TYPE_2: case CHD_COMP_TYPE_3:
+			m->length = chd_bits_read(&b, lengthbits);
+			curoffset += m->length;
+			chd_bits_read(&b, 16);		/* CRC-16 */
+			break;
+
+		case CHD_COMP_NONE:
+			m->length = chd->hunkbytes;
+			curoffset += m->length;
+			chd_bits_read(&b, 16);		/* CRC-16 */
+			break;
+
+		case CHD_COMP_SELF:
+			m->offset = last_self = chd_bits_read(&b, selfbits);
+			break;
+
+		case CHD_COMP_SELF_1:
+			last_self++;
+			/*FALLTHROUGH*/
+		case CHD_COMP_SELF_0:
+			m->type = CHD_COMP_SELF;
+			m->offset = last_self;
+			break;
+
+		case CHD_COMP_PARENT:
+			chd_bits_read(&b, parentbits);
+			/*FALLTHROUGH*/
+		default:
+			/* We never have a parent image. */
+			m->type = CHD_COMP_PARENT;
+			break;
+	}
+    }
+
+    free(comp);
+
+    return (b.pos <= (b.len + 4));
+}
+
+
+static void
+chd_ecc_init(void)
+{
+    int i, j;
+
+    if (ecc_init_done)
+	return;
+
+    for (i = 0; i < 256; i++) {
+	j = (i << 1) ^ ((i & 0x80) ? 0x11d : 0);
+	ecc_f_lut[i] = j & 0xff;
+	ecc_b_lut[(i ^ j) & 0xff] = i;
+    }
+
+    ecc_init_done = 1;
+}
+
+
+static void
+chd_ecc_block(uint8_t *src, uint32_t major_count, uint32_t minor_count,
+	      uint32_t major_mult, uint32_t minor_inc, uint8_t *dest)
+{
+    uint32_t size = major_count * minor_count;
+    uint32_t major, minor, index;
+    uint8_t a, b;
+
+    for (major = 0; major < major_count; major++) {
+	index = ((major >> 1) * major_mult) + (major & 1);
+	a = b = 0;
+	for (minor = 0; minor < minor_count; minor++) {
+		a ^= src[index];
+		b ^= src[index];
+		a = ecc_f_lut[a];
+		index += minor_inc;
+		if (index >= size)
+			index -= size;
+	}
+	a = ecc_b_lut[ecc_f_lut[a] ^ b];
+	dest[major] = a;
+	dest[major + major_count] = a ^ b;
+    }
+}
+
+
+/* Regenerate the Mode 1 P and Q parity stripped by the compressor. */
+static void
+chd_ecc_generate(uint8_t *sector)
+{
+    chd_ecc_block(sector + 0x00c, 86, 24,  2, 86, sector + 0x81c);
+    chd_ecc_block(sector + 0x00c, 52, 43, 86, 88, sector + 0x8c8);
+}
+
+
+static int
+chd_inflate(chd_ctx_t *ctx, const uint8_t *src, uint32_t src_len, uint8_t *dest, uint32_t dest_len)
+{
+    int ret;
+
+    if (inflateReset(&ctx->z) != Z_OK)
+	return 0;
+
+    ctx->z.next_in = (Bytef *) src;
+    ctx->z.avail_in = src_len;
+    ctx->z.next_out = dest;
+    ctx->z.avail_out = dest_len;
+
+    ret = inflate(&ctx->z, Z_FINISH);
+    if ((ret != Z_OK) && (ret != Z_STREAM_END))
+	return 0;
+
+    return (ctx->z.total_out == dest_len);
+}
+
+
+/* The CD codec deflates the sector data and the subchannel data of a
+   hunk separately, after stripping the sync header and the ECC. */
+static int
+chd_cdzl_decompress(chd_t *chd, chd_ctx_t *ctx, uint32_t src_len)
+{
+    uint32_t frames = chd->hunkbytes / CHD_FRAME_SIZE;
+    uint32_t complen_bytes = (chd->hunkbytes < 65536) ? 2 : 3;
+    uint32_t ecc_bytes = (frames + 7) / 8;
+    uint32_t header_bytes = ecc_bytes + complen_bytes;
+    uint32_t complen_base, i;
+    uint8_t *sector;
+
+    complen_base = chd_be16(&ctx->comp[ecc_bytes]);
+    if (complen_bytes > 2)
+	complen_base = (complen_base << 8) | ctx->comp[ecc_bytes + 2];
+
+    if ((header_bytes + complen_base) > src_len)
+	return 0;
+
+    if (!chd_inflate(ctx, &ctx->comp[header_bytes], complen_base,
+		     ctx->temp, frames * CHD_SECTOR_DATA))
+	return 0;
+    if (!chd_inflate(ctx, &ctx->comp[header_bytes + complen_base], src_len - complen_base - header_bytes,
+		     &ctx->temp[frames * CHD_SECTOR_DATA], frames * (CHD_FRAME_SIZE - CHD_SECTOR_DATA)))
+	return 0;
+
+    for (i = 0; i < frames; i++) {
+	sector = &ctx->data[i * CHD_FRAME_SIZE];
+	memcpy(sector, &ctx->temp[i * CHD_SECTOR_DATA], CHD_SECTOR_DATA);
+	memcpy(sector + CHD_SECTOR_DATA, &ctx->temp[(frames * CHD_SECTOR_DATA) + (i * (CHD_FRAME_SIZE - CHD_SECTOR_DATA))],
+	       CHD_FRAME_SIZE - CHD_SECTOR_DATA);
+
+	if (ctx->comp[i >> 3] & (1 << (i & 7))) {
+		memcpy(sector, chd_sync_header, sizeof(chd_sync_header));
+		chd_ecc_generate(sector);
+	}
+    }
+
+    return 1;
+}
+
+
+/* Decompress a hunk into the context's output buffer. */
+static int
+chd_decompress(chd_t *chd, chd_ctx_t *ctx, uint32_t hunk)
+{
+    chd_map_t *m = &chd->map[hunk];
+    uint32_t codec;
+
+    switch (m->type) {
+	case CHD_COMP_TYPE_0: case CHD_COMP_TYPE_1:
+	case CHD_COMP_TYPE_2: case CHD_COMP_TYPE_3:
+		codec = chd->compressors[m->type];
+		if ((m->length > chd->hunkbytes) || !chd_fread(ctx->file, ctx->comp, m->offset, m->length))
+			return 0;
+		if (codec == CHD_CODEC_ZLIB)
+			return chd_inflate(ctx, ctx->comp, m->length, ctx->data, chd->hunkbytes);
+		else if (codec == CHD_CODEC_CDZL)
+			return chd_cdzl_decompress(chd, ctx, m->length);
+		return 0;
+
+	case CHD_COMP_NONE:
+		if (m->offset == 0ULL) {
+			memset(ctx->data, 0x00, chd->hunkbytes);
+			return 1;
+		}
+		return chd_fread(ctx->file, ctx->data, m->offset, chd->hunkbytes);
+
+	case CHD_COMP_SELF:
+		/* A copy of an earlier hunk. */
+		if (m->offset >= hunk)
+			return 0;
+		return chd_decompress(chd, ctx, (uint32_t) m->offset);
+
+	default:
+		cdrom_image_chd_log("CHD: hunk %i needs a parent image\n", hunk);
+		return 0;
+    }
+}
+
+
+static chd_slot_t *
+chd_cache_find(chd_t *chd, uint32_t hunk)
+{
+    int i;
+
+    for (i = 0; i < CHD_CACHE_HUNKS; i++) {
+	if (chd->cache[i].hunk == (int32_t) hunk)
+		return &chd->cache[i];
+    }
+
+    return NULL;
+}
+
+
+/* Move a freshly decompressed hunk into the least recently used slot,
+   giving the old slot buffer to the context. Must hold the mutex. */
+static chd_slot_t *
+chd_cache_install(chd_t *chd, chd_ctx_t *ctx, uint32_t hunk)
+{
+    chd_slot_t *slot = &chd->cache[0];
+    uint8_t *temp;
+    int i;
+
+    for (i = 1; i < CHD_CACHE_HUNKS; i++) {
+	if (slot->hunk == -1)
+		break;
+	if ((chd->cache[i].hunk == -1) || (chd->cache[i].stamp < slot->stamp))
+		slot = &chd->cache[i];
+    }
+
+    temp = slot->data;
+    slot->data = ctx->data;
+    ctx->data = temp;
+
+    slot->hunk = hunk;
+    slot->stamp = ++chd->stamp;
+
+    return slot;
+}
+
+
+static void
+chd_prefetch_thread(void *priv)
+{
+    chd_t *chd = (chd_t *) priv;
+    int32_t hunk, i;
+    int cached;
+
+    for (;;) {
+	thread_wait_event(chd->pf_event, -1);
+	thread_reset_event(chd->pf_event);
+
+	if (chd->pf_stop)
+		break;
+
+	thread_wait_mutex(chd->mutex);
+	hunk = chd->pf_hunk;
+	thread_release_mutex(chd->mutex);
+
+	for (i = 0; (i < CHD_PREFETCH_HUNKS) && (((uint32_t) (hunk + i)) < chd->hunkcount); i++) {
+		if (chd->pf_stop)
+			break;
+
+		thread_wait_mutex(chd->mutex);
+		cached = (chd_cache_find(chd, hunk + i) != NULL);
+		thread_release_mutex(chd->mutex);
+		if (cached)
+			continue;
+
+		if (!chd_decompress(chd, &chd->pf, hunk + i))
+			break;
+
+		thread_wait_mutex(chd->mutex);
+		if (chd_cache_find(chd, hunk + i) == NULL)
+			chd_cache_install(chd, &chd->pf, hunk + i);
+		thread_release_mutex(chd->mutex);
+	}
+    }
+}
+
+
+/* Read one whole frame (sector data and subchannel data). */
+static int
+chd_read_frame(chd_t *chd, uint32_t frame, uint8_t *buffer)
+{
+    uint64_t offs = ((uint64_t) frame) * chd->unitbytes;
+    uint32_t hunk = (uint32_t) (offs / chd->hunkbytes);
+    chd_slot_t *slot;
+
+    if (hunk >= chd->hunkcount)
+	return 0;
+
+    thread_wait_mutex(chd->mutex);
+
+    slot = chd_cache_find(chd, hunk);
+    if ((slot == NULL) && chd_decompress(chd, &chd->rd, hunk))
+	slot = chd_cache_install(chd, &chd->rd, hunk);
+
+    if (slot != NULL) {
+	slot->stamp = ++chd->stamp;
+	memcpy(buffer, slot->data + (offs % chd->hunkbytes), CHD_FRAME_SIZE);
+
+	/* Entering the next hunk, keep the following ones coming. */
+	if (((int32_t) hunk) != chd->last_hunk) {
+		if ((((int32_t) hunk) == (chd->last_hunk + 1)) && (chd->pf_thread != NULL)) {
+			chd->pf_hunk = hunk + 1;
+			thread_set_event(chd->pf_event);
+		}
+		chd->last_hunk = hunk;
+	}
+    }
+
+    thread_release_mutex(chd->mutex);
+
+    return (slot != NULL);
+}
+
+
+static int
+chd_read(void *p, uint8_t *buffer, uint64_t seek, size_t count)
+{
+    track_file_t *tf = (track_file_t *) p;
+    chd_t *chd = (chd_t *) tf->priv;
+    uint8_t frame[CHD_FRAME_SIZE];
+    chd_track_t *trk;
+    uint64_t sect, offs, n;
+    int i;
+
+    cdrom_image_chd_log("CDROM: chd_read(pos=%" PRIu64 " count=%lu\n", seek, count);
+
+    while (count > 0) {
+	/* Find the track this offset is in, sequential reads stay in one. */
+	trk = &chd->tracks[chd->cur_track];
+	if ((seek < trk->virt) || (seek >= (trk->virt + ((uint64_t) trk->frames * trk->sector_size)))) {
+		for (i = 0; i < chd->tracks_num; i++) {
+			trk = &chd->tracks[i];
+			if ((seek >= trk->virt) && (seek < (trk->virt + ((uint64_t) trk->frames * trk->sector_size))))
+				break;
+		}
+		if (i == chd->tracks_num)
+			return 0;
+		chd->cur_track = i;
+	}
+
+	sect = (seek - trk->virt) / trk->sector_size;
+	offs = (seek - trk->virt) % trk->sector_size;
+	n = trk->sector_size - offs;
+	if (n > count)
+		n = count;
+
+	if (!chd_read_frame(chd, trk->frame + (uint32_t) sect, frame))
+		return 0;
+
+	/* Audio is stored big endian. */
+	if (trk->swap) {
+		for (i = 0; i < CHD_SECTOR_DATA; i += 2) {
+			frame[i] ^= frame[i + 1];
+			frame[i + 1] ^= frame[i];
+			frame[i] ^= frame[i + 1];
+		}
+	}
+
+	memcpy(buffer, &frame[offs], n);
+	buffer += n;
+	seek += n;
+	count -= n;
+    }
+
+    return 1;
+}
+
+
+static uint64_t
+chd_get_length(void *p)
+{
+    track_file_t *tf = (track_file_t *) p;
+    chd_t *chd = (chd_t *) tf->priv;
+
+    return chd->virt_len;
+}
+
+
+static void
+chd_ctx_close(chd_ctx_t *ctx)
+{
+    if (ctx->file != NULL)
+	fclose(ctx->file);
+    if (ctx->z_init)
+	inflateEnd(&ctx->z);
+    free(ctx->comp);
+    free(ctx->temp);
+    free(ctx->data);
+}
+
+
+static void
+chd_close(void *p)
+{
+    track_file_t *tf = (track_file_t *) p;
+    chd_t *chd;
+    int i;
+
+    if (tf == NULL)
+	return;
+
+    chd = (chd_t *) tf->priv;
+    if (chd != NULL) {
+	if (chd->pf_thread != NULL) {
+		chd->pf_stop = 1;
+		thread_set_event(chd->pf_event);
+		thread_wait(chd->pf_thread, -1);
+	}
+	if (chd->pf_event != NULL)
+		thread_destroy_event(chd->pf_event);
+	if (chd->mutex != NULL)
+		thread_close_mutex(chd->mutex);
+
+	chd_ctx_close(&chd->rd);
+	chd_ctx_close(&chd->pf);
+	for (i = 0; i < CHD_CACHE_HUNKS; i++)
+		free(chd->cache[i].data);
+	free(chd->map);
+	free(chd);
+    }
+
+    /* The reader context owns the file. */
+    tf->file = NULL;
+    memset(tf->fn, 0x00, sizeof(tf->fn));
+
+    free(p);
+}
+
+
+static int
+chd_ctx_init(chd_t *chd, chd_ctx_t *ctx)
+{
+    memset(&ctx->z, 0x00, sizeof(z_stream));
+    if (inflateInit2(&ctx->z, -MAX_WBITS) != Z_OK)
+	return 0;
+    ctx->z_init = 1;
+
+    ctx->comp = (uint8_t *) malloc(chd->hunkbytes);
+    ctx->temp = (uint8_t *) malloc(chd->hunkbytes);
+    ctx->data = (uint8_t *) malloc(chd->hunkbytes);
+
+    return (ctx->comp != NULL) && (ctx->temp != NULL) && (ctx->data != NULL);
+}
+
+
+static int
+chd_parse_track(chd_t *chd, const char *meta, int v2)
+{
+    char type[32], subtype[32], pgtype[32], pgsub[32];
+    int number, frames, pregap = 0, postgap = 0;
+    chd_track_t *trk;
+    int ret;
+
+    pgtype[0] = '\0';
+    if (v2) {
+	ret = sscanf(meta, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s PGSUB:%31s POSTGAP:%d",
+		     &number, type, subtype, &frames, &pregap, pgtype, pgsub, &postgap);
+	if (ret != 8)
+		return 0;
+    } else {
+	ret = sscanf(meta, "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d", &number, type, subtype, &frames);
+	if (ret != 4)
+		return 0;
+    }
+
+    /* Tracks are stored in order. */
+    if ((number != (chd->tracks_num + 1)) || (number > CHD_MAX_TRACKS) || (frames < 0) || (pregap < 0))
+	return 0;
+
+    trk = &chd->tracks[chd->tracks_num];
+    memset(trk, 0x00, sizeof(chd_track_t));
+    trk->number = number;
+    trk->attr = DATA_TRACK;
+
+    if (!strcmp(type, "MODE1"))
+	trk->sector_size = COOKED_SECTOR_SIZE;
+    else if (!strcmp(type, "MODE1_RAW"))
+	trk->sector_size = RAW_SECTOR_SIZE;
+    else if (!strcmp(type, "MODE2") || !strcmp(type, "MODE2_FORM_MIX")) {
+	trk->sector_size = 2336;
+	trk->mode2 = 1;
+    } else if (!strcmp(type, "MODE2_FORM1")) {
+	trk->sector_size = COOKED_SECTOR_SIZE;
+	trk->mode2 = 1;
+	trk->form = 1;
+    } else if (!strcmp(type, "MODE2_FORM2")) {
+	trk->sector_size = 2324;
+	trk->mode2 = 1;
+	trk->form = 2;
+    } else if (!strcmp(type, "MODE2_RAW")) {
+	trk->sector_size = RAW_SECTOR_SIZE;
+	trk->mode2 = 1;
+	trk->form = 1;		/* Assume this is XA Mode 2 Form 1. */
+    } else if (!strcmp(type, "AUDIO")) {
+	trk->sector_size = RAW_SECTOR_SIZE;
+	trk->attr = AUDIO_TRACK;
+	trk->swap = 1;
+    } else
+	return 0;
+
+    /* Raw sectors followed by subchannel data look like a 2448-byte .BIN. */
+    if ((trk->sector_size == RAW_SECTOR_SIZE) && strcmp(subtype, "NONE"))
+	trk->sector_size = 2448;
+
+    trk->frames = frames;
+    trk->pregap = pregap;
+    trk->pregap_in_file = (pgtype[0] == 'V');
+
+    chd->tracks_num++;
+
+    return 1;
+}
+
+
+static int
+chd_load_tracks(chd_t *chd, FILE *f)
+{
+    uint64_t offset = chd->metaoffset;
+    uint32_t tag, length, frame = 0, lba = 0;
+    uint8_t hdr[16];
+    char meta[256];
+    chd_track_t *trk;
+    int i;
+
+    while ((offset != 0ULL) && (chd->tracks_num < CHD_MAX_TRACKS)) {
+	if (!chd_fread(f, hdr, offset, sizeof(hdr)))
+		return 0;
+
+	tag = chd_be32(&hdr[0]);
+	length = chd_be24(&hdr[5]);
+
+	if ((tag == CHD_META_TRACK) || (tag == CHD_META_TRACK2)) {
+		if (length >= sizeof(meta))
+			length = sizeof(meta) - 1;
+		if (!chd_fread(f, meta, offset + sizeof(hdr), length))
+			return 0;
+		meta[length] = '\0';
+		if (!chd_parse_track(chd, meta, tag == CHD_META_TRACK2))
+			return 0;
+	}
+
+	offset = chd_be64(&hdr[8]);
+    }
+
+    if (chd->tracks_num == 0)
+	return 0;
+
+    /* Lay the tracks out, each one is padded to a multiple of four frames
+       in the image. Reads see the tracks' sectors back to back, with the
+       size of each track's sectors, like a single .BIN file. */
+    for (i = 0; i < chd->tracks_num; i++) {
+	trk = &chd->tracks[i];
+
+	if (trk->pregap_in_file && (trk->pregap > trk->frames))
+		return 0;
+
+	lba += trk->pregap;
+	trk->start = lba;
+	trk->frame = frame;
+	trk->virt = chd->virt_len;
+
+	lba += trk->frames - (trk->pregap_in_file ? trk->pregap : 0);
+	frame += trk->frames;
+	frame = ((frame + CHD_TRACK_PADDING - 1) / CHD_TRACK_PADDING) * CHD_TRACK_PADDING;
+
+	chd->virt_len += ((uint64_t) trk->frames) * trk->sector_size;
+    }
+
+    return (((uint64_t) frame) * chd->unitbytes) <= (((uint64_t) chd->hunkcount) * chd->hunkbytes);
+}
+
+
+static int
+chd_open(chd_t *chd, const wchar_t *fn)
+{
+    uint8_t hdr[CHD_V5_HEADER_SIZE];
+    uint64_t logicalbytes;
+    int i;
+
+    chd->rd.file = plat_fopen64(fn, L"rb");
+    if (chd->rd.file == NULL)
+	return 0;
+
+    if (!chd_fread(chd->rd.file, hdr, 0ULL, sizeof(hdr)) || memcmp(hdr, "MComprHD", 8) ||
+	(chd_be32(&hdr[8]) != CHD_V5_HEADER_SIZE) || (chd_be32(&hdr[12]) != 5)) {
+	cdrom_image_chd_log("CHD: not a version 5 CHD file\n");
+	return 0;
+    }
+
+    for (i = 0; i < 4; i++) {
+	chd->compressors[i] = chd_be32(&hdr[16 + (i << 2)]);
+	if ((chd->compressors[i] != CHD_CODEC_NONE) && (chd->compressors[i] != CHD_CODEC_ZLIB) &&
+	    (chd->compressors[i] != CHD_CODEC_CDZL)) {
+		cdrom_image_chd_log("CHD: unsupported codec %08X\n", chd->compressors[i]);
+		return 0;
+	}
+    }
+
+    logicalbytes = chd_be64(&hdr[32]);
+    chd->mapoffset = chd_be64(&hdr[40]);
+    chd->metaoffset = chd_be64(&hdr[48]);
+    chd->hunkbytes = chd_be32(&hdr[56]);
+    chd->unitbytes = chd_be32(&hdr[60]);
+
+    /* Parent (differential) images are not supported. */
+    for (i = 104; i < 124; i++) {
+	if (hdr[i] != 0x00)
+		return 0;
+    }
+
+    if ((chd->unitbytes != CHD_FRAME_SIZE) || (chd->hunkbytes == 0) ||
+	((chd->hunkbytes % chd->unitbytes) != 0) || (chd->hunkbytes > (1 << 24)))
+	return 0;
+
+    chd->hunkcount = (uint32_t) ((logicalbytes + chd->hunkbytes - 1) / chd->hunkbytes);
+
+    if (!chd_load_map(chd, chd->rd.file) || !chd_load_tracks(chd, chd->rd.file))
+	return 0;
+
+    /* The background prefetch reads through its own file handle. */
+    chd->pf.file = plat_fopen64(fn, L"rb");
+    if ((chd->pf.file == NULL) || !chd_ctx_init(chd, &chd->rd) || !chd_ctx_init(chd, &chd->pf))
+	return 0;
+
+    for (i = 0; i < CHD_CACHE_HUNKS; i++) {
+	chd->cache[i].hunk = -1;
+	chd->cache[i].data = (uint8_t *) malloc(chd->hunkbytes);
+	if (chd->cache[i].data == NULL)
+		return 0;
+    }
+
+    chd_ecc_init();
+
+    chd->last_hunk = chd->pf_hunk = -1;
+    chd->mutex = thread_create_mutex();
+    chd->pf_event = thread_create_event();
+    chd->pf_thread = thread_create(chd_prefetch_thread, chd);
+
+    return 1;
+}
+
+
+track_file_t *
+chd_init(const wchar_t *filename, int *error)
+{
+    track_file_t *tf = (track_file_t *) malloc(sizeof(track_file_t));
+    chd_t *chd;
+
+    *error = 1;
+
+    if (tf == NULL)
+	return NULL;
+
+    memset(tf, 0x00, sizeof(track_file_t));
+    if (wcslen(filename) <= 260)
+	wcscpy(tf->fn, filename);
+    else
+	wcsncpy(tf->fn, filename, 260);
+
+    tf->read = chd_read;
+    tf->get_length = chd_get_length;
+    tf->close = chd_close;
+
+    chd = (chd_t *) malloc(sizeof(chd_t));
+    if (chd == NULL) {
+	free(tf);
+	return NULL;
+    }
+    memset(chd, 0x00, sizeof(chd_t));
+    tf->priv = chd;
+
+    if (!chd_open(chd, tf->fn)) {
+	chd_close(tf);
+	return NULL;
+    }
+
+    tf->file = chd->rd.file;
+    cdrom_image_chd_log("CDROM: chd_open(%ls) = %i tracks, %i hunks\n", tf->fn, chd->tracks_num, chd->hunkcount);
+
+    *error = 0;
+    return tf;
+}
+
+
+/* Fill in a track from the image's track metadata, 0 past the last one. */
+int
+chd_get_track(track_file_t *tf, int track, track_t *trk)
+{
+    chd_t *chd = (chd_t *) tf->priv;
+    chd_track_t *ct;
+    uint32_t pregap;
+
+    if ((track < 0) || (track >= chd->tracks_num))
+	return 0;
+
+    ct = &chd->tracks[track];
+    pregap = ct->pregap_in_file ? ct->pregap : 0;
+
+    trk->number = trk->track_number = ct->number;
+    trk->attr = ct->attr;
+    trk->sector_size = ct->sector_size;
+    trk->mode2 = ct->mode2;
+    trk->form = ct->form;
+    trk->start = ct->start;
+    trk->length = ct->frames - pregap;
+    trk->skip = ct->virt + (((uint64_t) pregap) * ct->sector_size);
+    trk->file = tf;
+
+    return 1;
+}
@@ -55,6 +55,7 @@
 #include <86box/scsi.h>
 #include <86box/scsi_device.h>
 #include <86box/cdrom.h>
+#include <86box/cdrom_image_backend.h>
 #include <86box/zip.h>
 #include <86box/mo.h>
 #include <86box/sound.h>
@@ -565,6 +566,8 @@ load_machine(void)
 
     cpu_use_dynarec = !!config_get_int(cat, "cpu_use_dynarec", 0);
 
+    cpu_idle_skip = !!config_get_int(cat, "cpu_idle_skip", 1);
+
     p = config_get_string(cat, "time_sync", NULL);
     if (p != NULL) {        
 	if (!strcmp(p, "disabled"))
@@ -701,6 +704,14 @@ load_sound(void)
 	sound_is_float = 1;
       else
 	sound_is_float = 0;
+
+    sound_sync = !!config_get_int(cat, "sound_sync", 0);
+
+    sound_resample_quality = config_get_int(cat, "resample_quality", 0);
+    if ((sound_resample_quality < 0) || (sound_resample_quality > 3))
+	sound_resample_quality = 0;
+
+    sound_capture = !!config_get_int(cat, "sound_capture", 0);
 }
 
 
@@ -718,6 +729,12 @@ load_network(void)
 	else
 	if (!strcmp(p, "slirp") || !strcmp(p, "2"))
 		network_type = NET_TYPE_SLIRP;
+	else
+	if (!strcmp(p, "vlan") || !strcmp(p, "3"))
+		network_type = NET_TYPE_VLAN;
+	else
+	if (!strcmp(p, "reflect") || !strcmp(p, "4"))
+		network_type = NET_TYPE_REFLECT;
 	else
 		network_type = NET_TYPE_NONE;
     } else
@@ -753,6 +770,23 @@ load_network(void)
 	network_card = network_card_get_from_internal_name(p);
       else
 	network_card = 0;
+
+    p = config_get_string(cat, "net_vlan", "default");
+    memset(network_vlan, '\0', sizeof(network_vlan));
+    strncpy(network_vlan, p, sizeof(network_vlan) - 1);
+
+    network_speed = config_get_int(cat, "net_speed", NET_SPEED_10M);
+    if ((network_speed < NET_SPEED_10M) || (network_speed > NET_SPEED_MAX))
+	network_speed = NET_SPEED_10M;
+
+    network_capture = !!config_get_int(cat, "net_capture", 0);
+
+    network_reflect_size = config_get_int(cat, "net_reflect_size", 0);
+    if (network_reflect_size < 0)
+	network_reflect_size = 0;
+    network_reflect_rate = config_get_int(cat, "net_reflect_rate", 0);
+    if (network_reflect_rate < 0)
+	network_reflect_rate = 0;
 }
 
 
@@ -1176,6 +1210,13 @@ load_floppy_and_cdrom_drives(void)
 	sprintf(temp, "cdrom_%02i_speed", c+1);
 	cdrom[c].speed = config_get_int(cat, temp, 8);
 
+	sprintf(temp, "cdrom_%02i_readahead", c+1);
+	cdrom[c].readahead = config_get_int(cat, temp, CDI_READAHEAD_DEFAULT);
+	if (cdrom[c].readahead < 0)
+		cdrom[c].readahead = 0;
+	else if (cdrom[c].readahead > CDI_READAHEAD_MAX)
+		cdrom[c].readahead = CDI_READAHEAD_MAX;
+
 	/* Default values, needed for proper operation of the Settings dialog. */
 	cdrom[c].ide_channel = cdrom[c].scsi_device_id = c + 2;
 
@@ -1719,6 +1760,11 @@ save_machine(void)
 
     config_set_int(cat, "cpu_use_dynarec", cpu_use_dynarec);
 
+    if (cpu_idle_skip == 1)
+	config_delete_var(cat, "cpu_idle_skip");
+      else
+	config_set_int(cat, "cpu_idle_skip", cpu_idle_skip);
+
     if (time_sync & TIME_SYNC_ENABLED)
 	if (time_sync & TIME_SYNC_UTC)
 		config_set_string(cat, "time_sync", "utc");
@@ -1854,6 +1900,21 @@ save_sound(void)
       else
 	config_set_string(cat, "sound_type", (sound_is_float == 1) ? "float" : "int16");
 
+    if (sound_sync == 0)
+	config_delete_var(cat, "sound_sync");
+      else
+	config_set_int(cat, "sound_sync", sound_sync);
+
+    if (sound_resample_quality == 0)
+	config_delete_var(cat, "resample_quality");
+      else
+	config_set_int(cat, "resample_quality", sound_resample_quality);
+
+    if (sound_capture == 0)
+	config_delete_var(cat, "sound_capture");
+      else
+	config_set_int(cat, "sound_capture", sound_capture);
+
     delete_section_if_empty(cat);
 }
 
@@ -1868,7 +1929,14 @@ save_network(void)
 	config_delete_var(cat, "net_type");
       else
 	config_set_string(cat, "net_type",
-		(network_type == NET_TYPE_SLIRP) ? "slirp" : "pcap");
+		(network_type == NET_TYPE_REFLECT) ? "reflect" :
+		(network_type == NET_TYPE_VLAN) ? "vlan" :
+		((network_type == NET_TYPE_SLIRP) ? "slirp" : "pcap"));
+
+    if (! strcmp(network_vlan, "default"))
+	config_delete_var(cat, "net_vlan");
+      else
+	config_set_string(cat, "net_vlan", network_vlan);
 
     if (network_host[0] != '\0') {
 	if (! strcmp(network_host, "none"))
@@ -1886,6 +1954,26 @@ save_network(void)
 	config_set_string(cat, "net_card",
 			  network_card_get_internal_name(network_card));
 
+    if (network_speed == NET_SPEED_10M)
+	config_delete_var(cat, "net_speed");
+      else
+	config_set_int(cat, "net_speed", network_speed);
+
+    if (network_capture == 0)
+	config_delete_var(cat, "net_capture");
+      else
+	config_set_int(cat, "net_capture", network_capture);
+
+    if (network_reflect_size == 0)
+	config_delete_var(cat, "net_reflect_size");
+      else
+	config_set_int(cat, "net_reflect_size", network_reflect_size);
+
+    if (network_reflect_rate == 0)
+	config_delete_var(cat, "net_reflect_rate");
+      else
+	config_set_int(cat, "net_reflect_rate", network_reflect_rate);
+
     delete_section_if_empty(cat);
 }
 
@@ -2117,6 +2205,13 @@ save_floppy_and_cdrom_drives(void)
 		config_set_int(cat, temp, cdrom[c].speed);
 	}
 
+	sprintf(temp, "cdrom_%02i_readahead", c+1);
+	if ((cdrom[c].bus_type == 0) || (cdrom[c].readahead == CDI_READAHEAD_DEFAULT)) {
+		config_delete_var(cat, temp);
+	} else {
+		config_set_int(cat, temp, cdrom[c].readahead);
+	}
+
 	sprintf(temp, "cdrom_%02i_parameters", c+1);
 	if (cdrom[c].bus_type == 0) {
 		config_delete_var(cat, temp);
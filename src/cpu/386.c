@@ -281,6 +281,11 @@ exec386(int cycs)
 			}
 		}
 
+		/* A short backward jump may have closed a polling loop. */
+		if ((cpu_state.pc < cpu_state.oldpc) &&
+		    ((cpu_state.oldpc - cpu_state.pc) <= IDLE_LOOP_SPAN))
+			cycles -= idle_loop_check(cs + cpu_state.pc);
+
 		ins_cycles -= cycles;
 		tsc += ins_cycles;
 
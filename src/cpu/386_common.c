@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -14,6 +15,7 @@
 #include <86box/timer.h>
 #include "x86.h"
 #include "x87.h"
+#include <86box/io.h>
 #include <86box/nmi.h>
 #include <86box/mem.h>
 #include <86box/smram.h>
@@ -1812,6 +1814,389 @@ sysret(uint32_t fetchdat)
 }
 
 
+
+/*
+ * Idle loop detection.
+ *
+ * DOS programs and BIOS routines often wait for something by polling a
+ * port or a memory location in a short loop. If the CPU comes back to
+ * the same loop head with every register, the lazy flags and the count
+ * of port writes all unchanged, another pass can only differ from the
+ * last one once a device or an interrupt changes what the loop reads,
+ * and devices only change state from timer callbacks. Such a loop is
+ * fast-forwarded towards the next timer event instead of being run
+ * pass after pass.
+ *
+ * Unchanged registers say nothing about memory (an "inc word [cnt]"
+ * followed by the compare of the polled value leaves no trace in them),
+ * so the loop body is also decoded once per streak, and only loops made
+ * of instructions that cannot store to memory are skipped.
+ *
+ * The skip is capped at IDLE_LOOP_MAX_US, because a few devices (the
+ * PIT counter read-back above all) derive what they return from the
+ * current time rather than from a timer callback.
+ */
+#define IDLE_LOOP_CONFIRM	8	/* Identical passes before skipping. */
+#define IDLE_LOOP_MAX_US	10	/* Longest skip, in emulated microseconds. */
+#define IDLE_LOOP_SLOTS		32	/* Loops tracked for the report. */
+
+
+typedef struct {
+    uint32_t	head, regs[8],
+		flags_res, flags_op1, flags_op2,
+		seg_base[5], io_writes;
+    int		flags_op, TOP;
+    uint16_t	flags, eflags, npxs, pad;
+} idle_state_t;
+
+typedef struct {
+    uint32_t	head, hits;
+    uint64_t	skipped;
+} idle_loop_t;
+
+
+static idle_state_t	idle_last;
+static int		idle_passes, idle_pure;
+static idle_loop_t	idle_loops[IDLE_LOOP_SLOTS];
+static int		idle_loops_num, idle_loops_cur;
+
+
+static void
+idle_loop_count(uint32_t head, int skip)
+{
+    int c;
+
+    if ((idle_loops_cur >= idle_loops_num) || (idle_loops[idle_loops_cur].head != head)) {
+	for (c = 0; c < idle_loops_num; c++) {
+		if (idle_loops[c].head == head)
+			break;
+	}
+	if (c == idle_loops_num) {
+		if (idle_loops_num == IDLE_LOOP_SLOTS)
+			return;
+		idle_loops[c].head = head;
+		idle_loops[c].hits = 0;
+		idle_loops[c].skipped = 0;
+		idle_loops_num++;
+	}
+	idle_loops_cur = c;
+    }
+
+    idle_loops[idle_loops_cur].hits++;
+    idle_loops[idle_loops_cur].skipped += skip;
+}
+
+
+/* Bytes taken by the ModR/M byte at p and what follows it; 0 if they run past end. */
+static int
+idle_loop_modrm(uint32_t p, uint32_t end, int a32, int *mod, int *reg)
+{
+    uint8_t b;
+    int rm, len = 1;
+
+    if (p >= end)
+	return 0;
+
+    b = fastreadb(p);
+    *mod = b >> 6;
+    *reg = (b >> 3) & 7;
+    rm = b & 7;
+
+    if (*mod == 3)
+	return 1;
+
+    if (a32) {
+	if (rm == 4) {
+		if ((p + 1) >= end)
+			return 0;
+		if ((*mod == 0) && ((fastreadb(p + 1) & 7) == 5))
+			len += 4;
+		len++;
+	} else if ((*mod == 0) && (rm == 5))
+		len += 4;
+	if (*mod == 1)
+		len++;
+	else if (*mod == 2)
+		len += 4;
+    } else {
+	if ((*mod == 0) && (rm == 6))
+		len += 2;
+	if (*mod == 1)
+		len++;
+	else if (*mod == 2)
+		len += 2;
+    }
+
+    return ((p + len) <= end) ? len : 0;
+}
+
+
+/*
+ * Decode the loop starting at head, up to the jump that closes it, and
+ * see that nothing in it can store to memory or write a port. Anything
+ * not known to be harmless, and any branch that leaves the straight
+ * line other than to just past the closing jump, makes the loop impure.
+ */
+static int
+idle_loop_pure(uint32_t head)
+{
+    uint32_t p = head, end, next, target, exit_max = 0;
+    int op, op32, a32, mod, reg, len, rel_len, cond;
+    int32_t rel;
+
+    end = (head & ~0xfff) + 0x1000;
+    if (end > (head + IDLE_LOOP_SPAN + 16))
+	end = head + IDLE_LOOP_SPAN + 16;
+
+    while (p < end) {
+	op32 = a32 = !!use32;
+
+	op = fastreadb(p++);
+	while ((op == 0x26) || (op == 0x2e) || (op == 0x36) || (op == 0x3e) ||
+	       (op == 0x64) || (op == 0x65) || (op == 0x66) || (op == 0x67) ||
+	       (op == 0xf2) || (op == 0xf3)) {
+		if (op == 0x66)
+			op32 ^= 1;
+		else if (op == 0x67)
+			a32 ^= 1;
+		if (p >= end)
+			return 0;
+		op = fastreadb(p++);
+	}
+
+	len = rel_len = cond = 0;
+	mod = 3;
+	reg = 0;
+
+	switch (op) {
+		case 0x02: case 0x03: case 0x0a: case 0x0b:
+		case 0x12: case 0x13: case 0x1a: case 0x1b:
+		case 0x22: case 0x23: case 0x2a: case 0x2b:
+		case 0x32: case 0x33: case 0x3a: case 0x3b:
+		case 0x38: case 0x39: case 0x84: case 0x85:
+		case 0x8a: case 0x8b: case 0x8d:
+			/* Register destination, or compare/test. */
+			len = idle_loop_modrm(p, end, a32, &mod, &reg);
+			if (len == 0)
+				return 0;
+			break;
+
+		case 0x86: case 0x87: case 0x88: case 0x89: case 0x8c:
+		case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+			/* Only with a register destination. */
+			len = idle_loop_modrm(p, end, a32, &mod, &reg);
+			if ((len == 0) || (mod != 3))
+				return 0;
+			break;
+
+		case 0xc0: case 0xc1:
+			len = idle_loop_modrm(p, end, a32, &mod, &reg);
+			if ((len == 0) || (mod != 3))
+				return 0;
+			len++;
+			break;
+
+		case 0x80: case 0x81: case 0x83:
+			/* Group 1: CMP, or anything into a register. */
+			len = idle_loop_modrm(p, end, a32, &mod, &reg);
+			if ((len == 0) || ((mod != 3) && (reg != 7)))
+				return 0;
+			len += (op == 0x81) ? (op32 ? 4 : 2) : 1;
+			break;
+
+		case 0xf6: case 0xf7:
+			/* Group 3: NOT and NEG store, the rest only read. */
+			len = idle_loop_modrm(p, end, a32, &mod, &reg);
+			if ((len == 0) || ((mod != 3) && ((reg == 2) || (reg == 3))))
+				return 0;
+			if (reg < 2)
+				len += (op == 0xf7) ? (op32 ? 4 : 2) : 1;
+			break;
+
+		case 0xfe: case 0xff:
+			/* INC and DEC of a register only. */
+			len = idle_loop_modrm(p, end, a32, &mod, &reg);
+			if ((len == 0) || (mod != 3) || (reg > 1))
+				return 0;
+			break;
+
+		case 0x04: case 0x0c: case 0x14: case 0x1c:
+		case 0x24: case 0x2c: case 0x34: case 0x3c:
+		case 0xa8: case 0xb0: case 0xb1: case 0xb2: case 0xb3:
+		case 0xb4: case 0xb5: case 0xb6: case 0xb7:
+		case 0xe4: case 0xe5:
+			len = 1;
+			break;
+
+		case 0x05: case 0x0d: case 0x15: case 0x1d:
+		case 0x25: case 0x2d: case 0x35: case 0x3d:
+		case 0xa9: case 0xb8: case 0xb9: case 0xba: case 0xbb:
+		case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+			len = op32 ? 4 : 2;
+			break;
+
+		case 0xa0: case 0xa1:
+			len = a32 ? 4 : 2;
+			break;
+
+		case 0x40: case 0x41: case 0x42: case 0x43:
+		case 0x44: case 0x45: case 0x46: case 0x47:
+		case 0x48: case 0x49: case 0x4a: case 0x4b:
+		case 0x4c: case 0x4d: case 0x4e: case 0x4f:
+		case 0x90: case 0x91: case 0x92: case 0x93:
+		case 0x94: case 0x95: case 0x96: case 0x97:
+		case 0x98: case 0x99: case 0x9e: case 0x9f:
+		case 0xa6: case 0xa7: case 0xac: case 0xad:
+		case 0xae: case 0xaf: case 0xd7: case 0xec: case 0xed:
+		case 0xf5: case 0xf8: case 0xf9: case 0xfa:
+		case 0xfb: case 0xfc: case 0xfd:
+			break;
+
+		case 0x70: case 0x71: case 0x72: case 0x73:
+		case 0x74: case 0x75: case 0x76: case 0x77:
+		case 0x78: case 0x79: case 0x7a: case 0x7b:
+		case 0x7c: case 0x7d: case 0x7e: case 0x7f:
+		case 0xe0: case 0xe1: case 0xe2: case 0xe3:
+			rel_len = 1;
+			cond = 1;
+			break;
+
+		case 0xeb:
+			rel_len = 1;
+			break;
+
+		case 0xe9:
+			rel_len = op32 ? 4 : 2;
+			break;
+
+		case 0x0f:
+			if (p >= end)
+				return 0;
+			op = fastreadb(p++);
+			if ((op >= 0x80) && (op <= 0x8f)) {
+				rel_len = op32 ? 4 : 2;
+				cond = 1;
+			} else if ((op == 0xb6) || (op == 0xb7) || (op == 0xbe) || (op == 0xbf)) {
+				len = idle_loop_modrm(p, end, a32, &mod, &reg);
+				if (len == 0)
+					return 0;
+			} else if (op != 0x31)
+				return 0;
+			break;
+
+		default:
+			return 0;
+	}
+
+	if ((p + len + rel_len) > end)
+		return 0;
+	p += len;
+
+	if (rel_len == 0)
+		continue;
+
+	if (rel_len == 1)
+		rel = (int8_t) fastreadb(p);
+	else if (rel_len == 2)
+		rel = (int16_t) (fastreadb(p) | (fastreadb(p + 1) << 8));
+	else
+		rel = (int32_t) (fastreadb(p) | (fastreadb(p + 1) << 8) |
+				 (fastreadb(p + 2) << 16) | ((uint32_t) fastreadb(p + 3) << 24));
+	next = p + rel_len;
+	target = next + rel;
+	p = next;
+
+	if (target == head)
+		return (exit_max <= next);
+
+	/* Other branches may only leave the loop forwards. */
+	if (!cond || (target <= head) || (target < next))
+		return 0;
+	if (target > exit_max)
+		exit_max = target;
+    }
+
+    return 0;
+}
+
+
+/* Called at a loop head (linear address); returns the cycles to skip. */
+int
+idle_loop_check(uint32_t head)
+{
+    idle_state_t st;
+    int c, skip, max;
+
+    if (!cpu_idle_skip)
+	return 0;
+
+    if (smi_line || (nmi && nmi_enable && nmi_mask) ||
+	((cpu_state.flags & I_FLAG) && pic.int_pending)) {
+	idle_passes = 0;
+	return 0;
+    }
+
+    memset(&st, 0x00, sizeof(idle_state_t));
+    st.head = head;
+    for (c = 0; c < 8; c++)
+	st.regs[c] = cpu_state.regs[c].l;
+    st.flags_res = cpu_state.flags_res;
+    st.flags_op1 = cpu_state.flags_op1;
+    st.flags_op2 = cpu_state.flags_op2;
+    st.flags_op = cpu_state.flags_op;
+    st.flags = cpu_state.flags;
+    st.eflags = cpu_state.eflags;
+    st.npxs = cpu_state.npxs;
+    st.TOP = cpu_state.TOP;
+    st.seg_base[0] = cpu_state.seg_ds.base;
+    st.seg_base[1] = cpu_state.seg_es.base;
+    st.seg_base[2] = cpu_state.seg_ss.base;
+    st.seg_base[3] = cpu_state.seg_fs.base;
+    st.seg_base[4] = cpu_state.seg_gs.base;
+    st.io_writes = io_write_count;
+
+    if (memcmp(&st, &idle_last, sizeof(idle_state_t))) {
+	idle_last = st;
+	idle_passes = 0;
+	return 0;
+    }
+
+    if (idle_passes < IDLE_LOOP_CONFIRM) {
+	if (++idle_passes == IDLE_LOOP_CONFIRM)
+		idle_pure = idle_loop_pure(head);
+	return 0;
+    }
+
+    if (!idle_pure)
+	return 0;
+
+    skip = (int) (timer_target - (uint32_t) tsc);
+    max = IDLE_LOOP_MAX_US * (int) (TIMER_USEC >> 32);
+    if (skip > max)
+	skip = max;
+    if (skip > cycles)
+	skip = cycles;
+    if (skip <= 0)
+	return 0;
+
+    idle_loop_count(head, skip);
+    cpu_idle_cycles += skip;
+
+    return skip;
+}
+
+
+void
+idle_loop_report(void)
+{
+    int c;
+
+    for (c = 0; c < idle_loops_num; c++) {
+	x386_common_log("Idle loop at %08X: skipped %u times, %" PRIu64 " cycles\n",
+			idle_loops[c].head, idle_loops[c].hits, idle_loops[c].skipped);
+    }
+}
+
 #ifndef USE_DYNAREC
 /* This is for compatibility with new x87 code. */
 void codegen_set_rounding_mode(int mode)
@@ -50,6 +50,11 @@
 int checkio(int port);
 
 
+#define IDLE_LOOP_SPAN	64	/* Longest polling loop body, in bytes. */
+
+extern int	idle_loop_check(uint32_t head);
+
+
 #ifdef USE_NEW_DYNAREC
 #define check_io_perm(port) if (!IOPLp || (cpu_state.eflags&VM_FLAG)) \
                         { \
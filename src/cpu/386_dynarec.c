@@ -271,6 +271,7 @@ static void prefetch_flush()
 #ifdef USE_DYNAREC
 static int cycles_main = 0, cycles_old = 0;
 static uint64_t tsc_old = 0;
+static uint32_t idle_block = 0xffffffff;
 
 #ifdef USE_ACYCS
 int acycs = 0;
@@ -343,6 +344,15 @@ void exec386_dynarec(int cycs)
 			cycles_old = cycles;
 			oldtsc = tsc;
 			tsc_old = tsc;
+
+			/* A block that comes straight back to itself may be a
+			   polling loop; HLT already skips ahead on its own. The
+			   skipped cycles are taken after the counts above, so
+			   they reach tsc along with the block's own. */
+			if (((cs + cpu_state.pc) == idle_block) && (fastreadb(idle_block) != 0xf4))
+				cycles -= idle_loop_check(idle_block);
+			idle_block = cs + cpu_state.pc;
+
 			if (!CACHE_ON()) /*Interpret block*/
 			{
 				cpu_block_end = 0;
@@ -174,6 +174,7 @@ int		is286,
 int		hasfpu;
 
 uint64_t	tsc = 0;
+uint64_t	cpu_idle_cycles = 0;		/* Cycles skipped in HLT. */
 msr_t		msr;
 cpu_state_t     cpu_state;
 uint64_t	pmc[2] = {0, 0};
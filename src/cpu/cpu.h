@@ -414,6 +414,7 @@ extern uint32_t		cpu_cur_status;
 #endif
 extern uint64_t		cpu_CR4_mask;
 extern uint64_t		tsc;
+extern uint64_t		cpu_idle_cycles;
 extern msr_t		msr;
 extern cpu_state_t	cpu_state;
 extern uint8_t		opcode;
@@ -577,6 +578,8 @@ extern void	x87_reset(void);
 extern int	cpu_effective, cpu_alt_reset;
 extern void	cpu_dynamic_switch(int new_cpu);
 
+extern void	idle_loop_report(void);
+
 extern void	cpu_ven_reset(void);
 extern void	update_tsc(void);
 
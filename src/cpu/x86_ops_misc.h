@@ -605,8 +605,24 @@ static int opF7_l_a32(uint32_t fetchdat)
 }
 
 
+/*Nothing but a timer can wake a halted CPU, so skip straight to the next
+  timer event, within what is left of the current slice.*/
+static __inline int hlt_skip_cycles(void)
+{
+        int skip = (int)(timer_target - (uint32_t)tsc) + 1;
+
+        if (skip > cycles)
+                skip = cycles;
+        if (skip < 100)
+                skip = 100;
+
+        return skip;
+}
+
 static int opHLT(uint32_t fetchdat)
 {
+        int skip;
+
         if ((CPL || (cpu_state.eflags&VM_FLAG)) && (cr0&1))
         {
                 x86gpf(NULL,0);
@@ -616,7 +632,9 @@ static int opHLT(uint32_t fetchdat)
 		enter_smm_check(1);
         else if (!((cpu_state.flags & I_FLAG) && pic.int_pending))
         {
-                CLOCK_CYCLES_ALWAYS(100);
+                skip = hlt_skip_cycles();
+                CLOCK_CYCLES_ALWAYS(skip);
+                cpu_idle_cycles += skip;
 		if (!((cpu_state.flags & I_FLAG) && pic.int_pending))
                 	cpu_state.pc--;
         }
@@ -156,6 +156,17 @@ typedef struct {
     void	*prev;
 } sector_t;
 
+/* A track record of the image, kept in memory once it has been read. */
+typedef struct {
+    uint16_t	side_flags;
+    int32_t	extra_bit_cells;
+    uint32_t	index_hole_pos;
+    uint32_t	size, alloc;		/* Bytes in use and allocated per array. */
+    uint8_t	loaded, dirty;
+    uint16_t	*encoded_data,
+		*surface_data;
+} d86f_track_t;
+
 /* Disk flags:
  *  Bit 0	Has surface data (1 = yes, 0 = no)
  *  Bits 2, 1	Hole (3 = ED + 2000 kbps, 2 = ED, 1 = HD, 0 = DD)
@@ -207,6 +218,12 @@ typedef struct {
     wchar_t	original_file_name[2048];
     uint8_t	*filebuf, *outbuf;
     sector_t	*last_side_sector[2];
+    d86f_track_t *tracks;		/* Track cache, by logical track. */
+    int		table_dirty;
+    volatile int wb_run;
+    thread_t	*wb_thread;
+    event_t	*wb_event;
+    mutex_t	*wb_mutex;
 } d86f_t;
 
 
@@ -2272,10 +2289,24 @@ d86f_sector_is_present(int drive, int side, uint8_t c, uint8_t h, uint8_t r, uin
 }
 
 
+/* Whether a turbo mode sector transfer can be done in one go rather
+   than a byte per poll: a verify has no data to transfer, and DMA does
+   not need the CPU to keep up with the drive. */
+static int
+d86f_turbo_burst(uint8_t state)
+{
+    if (state == STATE_16_VERIFY_DATA)
+	return 1;
+
+    return d86f_fdc->dma && !(d86f_fdc->flags & FDC_FLAG_PCJR);
+}
+
+
 void
 d86f_turbo_poll(int drive, int side)
 {
     d86f_t *dev = d86f[drive];
+    uint8_t state;
 
     if ((dev->state != STATE_IDLE) && (dev->state != STATE_SECTOR_NOT_FOUND) && ((dev->state & 0xF8) != 0xE8)) {
 	if (! d86f_can_read_address(drive)) {
@@ -2373,12 +2404,19 @@ d86f_turbo_poll(int drive, int side)
 	case STATE_0C_READ_DATA:
 	case STATE_11_SCAN_DATA:
 	case STATE_16_VERIFY_DATA:
-		d86f_turbo_read(drive, side);
+		/* With DMA nobody has to pick up each byte, so move the whole sector at once. */
+		state = dev->state;
+		do
+			d86f_turbo_read(drive, side);
+		while (d86f_turbo_burst(state) && (dev->state == state));
 		break;
 
 	case STATE_05_WRITE_DATA:
 	case STATE_09_WRITE_DATA:
-		d86f_turbo_write(drive, side);
+		state = dev->state;
+		do
+			d86f_turbo_write(drive, side);
+		while (d86f_turbo_burst(state) && (dev->state == state));
 		break;
 
 	case STATE_0D_FORMAT_TRACK:
@@ -2887,10 +2925,121 @@ d86f_track_header_size(int drive)
 }
 
 
+/* Read a track record into the cache, the first time it is needed. */
+static d86f_track_t *
+d86f_cache_load(int drive, int logical_track, int thin_track, int side)
+{
+    d86f_t *dev = d86f[drive];
+    d86f_track_t *t = &dev->tracks[logical_track];
+    uint32_t size;
+
+    if (t->loaded)
+	return t;
+
+    if (fseek(dev->f, dev->track_offset[logical_track], SEEK_SET) == -1)
+	fatal("d86f_cache_load(): Error seeking to offset dev->track_offset[logical_track]\n");
+    if (fread(&t->side_flags, 1, 2, dev->f) != 2)
+	fatal("d86f_cache_load(): Error reading side flags\n");
+    t->extra_bit_cells = 0;
+    if (d86f_has_extra_bit_cells(drive)) {
+	if (fread(&t->extra_bit_cells, 1, 4, dev->f) != 4)
+		fatal("d86f_cache_load(): Error reading number of extra bit cells\n");
+	/* If RPM shift is 0% and direction is 1, do not adjust extra bit cells,
+	   as that is the whole track length. */
+	if (d86f_get_rpm_mode(drive) || !d86f_get_speed_shift_dir(drive)) {
+		if (t->extra_bit_cells < -32768)
+			t->extra_bit_cells = -32768;
+		if (t->extra_bit_cells > 32768)
+			t->extra_bit_cells = 32768;
+	}
+    }
+    t->index_hole_pos = 0;
+    fread(&t->index_hole_pos, 4, 1, dev->f);
+
+    /* A thin track takes its size from the thick track, as the array
+       size depends on the extra bit cells. */
+    if (! thin_track)
+	dev->extra_bit_cells[side] = t->extra_bit_cells;
+    size = d86f_get_array_size(drive, side, 0);
+
+    if (size > t->alloc) {
+	t->encoded_data = (uint16_t *) realloc(t->encoded_data, size);
+	if (d86f_has_surface_desc(drive))
+		t->surface_data = (uint16_t *) realloc(t->surface_data, size);
+	t->alloc = size;
+    }
+    memset(t->encoded_data, 0x00, size);
+    if (d86f_has_surface_desc(drive))
+	memset(t->surface_data, 0x00, size);
+
+    fread(t->encoded_data, 1, size, dev->f);
+    if (d86f_has_surface_desc(drive))
+	fread(t->surface_data, 1, size, dev->f);
+
+    t->size = size;
+    t->loaded = 1;
+
+    return t;
+}
+
+
+/* Put a track record into the cache, the writeback thread writes it out. */
+static void
+d86f_cache_store(int drive, int logical_track, int side, uint16_t *da, uint16_t *sa)
+{
+    d86f_t *dev = d86f[drive];
+    d86f_track_t *t = &dev->tracks[logical_track];
+    uint32_t size = d86f_get_array_size(drive, side, 0);
+
+    thread_wait_mutex(dev->wb_mutex);
+
+    if (size > t->alloc) {
+	t->encoded_data = (uint16_t *) realloc(t->encoded_data, size);
+	if (d86f_has_surface_desc(drive))
+		t->surface_data = (uint16_t *) realloc(t->surface_data, size);
+	t->alloc = size;
+    }
+
+    t->side_flags = d86f_handler[drive].side_flags(drive);
+    t->extra_bit_cells = d86f_handler[drive].extra_bit_cells(drive, side);
+    t->index_hole_pos = d86f_handler[drive].index_hole_pos(drive, side);
+    t->size = size;
+
+    memcpy(t->encoded_data, da, size);
+    if (d86f_has_surface_desc(drive))
+	memcpy(t->surface_data, sa, size);
+
+    t->loaded = t->dirty = 1;
+
+    thread_release_mutex(dev->wb_mutex);
+}
+
+
+static void
+d86f_cache_close(d86f_t *dev)
+{
+    int i;
+
+    if (dev->tracks == NULL)
+	return;
+
+    for (i = 0; i < 512; i++) {
+	if (dev->tracks[i].encoded_data)
+		free(dev->tracks[i].encoded_data);
+	if (dev->tracks[i].surface_data)
+		free(dev->tracks[i].surface_data);
+    }
+
+    free(dev->tracks);
+    dev->tracks = NULL;
+}
+
+
 void
 d86f_read_track(int drive, int track, int thin_track, int side, uint16_t *da, uint16_t *sa)
 {
     d86f_t *dev = d86f[drive];
+    d86f_track_t *t;
     int logical_track = 0;
     int array_size = 0;
 
@@ -2899,7 +3048,22 @@ d86f_read_track(int drive, int track, int thin_track, int side, uint16_t *da, ui
 	else
 	logical_track = track + thin_track;
 
-    if (dev->track_offset[logical_track]) {
+    if (dev->track_offset[logical_track] && (dev->tracks != NULL)) {
+	thread_wait_mutex(dev->wb_mutex);
+	t = d86f_cache_load(drive, logical_track, thin_track, side);
+	if (! thin_track) {
+		dev->side_flags[side] = t->side_flags;
+		dev->extra_bit_cells[side] = t->extra_bit_cells;
+		dev->index_hole_pos[side] = t->index_hole_pos;
+	}
+	array_size = d86f_get_array_size(drive, side, 0);
+	if (array_size > t->size)
+		array_size = t->size;
+	memcpy(da, t->encoded_data, array_size);
+	if (d86f_has_surface_desc(drive))
+		memcpy(sa, t->surface_data, array_size);
+	thread_release_mutex(dev->wb_mutex);
+    } else if (dev->track_offset[logical_track]) {
 	if (! thin_track) {
 		if (fseek(dev->f, dev->track_offset[logical_track], SEEK_SET) == -1)
 			fatal("d86f_read_track(): Error seeking to offset dev->track_offset[logical_track]\n");
@@ -3055,10 +3219,14 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
     int side, thin_track;
     int logical_track = 0;
     uint32_t *tbl;
+    int cached;
     tbl = dev->track_offset;
     fdd_side = fdd_get_head(drive);
     sides = d86f_get_sides(drive);
 
+    /* Writing back to the image itself goes through the track cache. */
+    cached = (track_table == NULL) && (f == &dev->f) && (dev->tracks != NULL);
+
     if (track_table != NULL)
 	tbl = track_table;
 
@@ -3081,7 +3249,9 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 				tbl[logical_track] = ftell(*f);
 			}
 
-			if (tbl[logical_track]) {
+			if (tbl[logical_track] && cached)
+				d86f_cache_store(drive, logical_track, side, dev->thin_track_encoded_data[thin_track][side], dev->thin_track_surface_data[thin_track][side]);
+			else if (tbl[logical_track]) {
 				fseek(*f, tbl[logical_track], SEEK_SET);
 				d86f_write_track(drive, f, side, dev->thin_track_encoded_data[thin_track][side], dev->thin_track_surface_data[thin_track][side]);
 			}
@@ -3100,7 +3270,9 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 			tbl[logical_track] = ftell(*f);
 		}
 
-		if (tbl[logical_track]) {
+		if (tbl[logical_track] && cached)
+			d86f_cache_store(drive, logical_track, side, d86f_handler[drive].encoded_data(drive, side), dev->track_surface_data[side]);
+		else if (tbl[logical_track]) {
 			if (fseek(*f, tbl[logical_track], SEEK_SET) == -1)
 				fatal("d86f_write_tracks(): Error seeking to offset tbl[logical_track]\n");
 			d86f_write_track(drive, f, side, d86f_handler[drive].encoded_data(drive, side), dev->track_surface_data[side]);
@@ -3112,34 +3284,57 @@ d86f_write_tracks(int drive, FILE **f, uint32_t *track_table)
 }
 
 
-void
-d86f_writeback(int drive)
+/* Write the track table and the dirty tracks out to the image. */
+static void
+d86f_flush(d86f_t *dev)
 {
-    d86f_t *dev = d86f[drive];
-    uint8_t header[32];
-    int header_size, size;
+    d86f_track_t *t;
+    int i, size;
 #ifdef D86F_COMPRESS
+    uint8_t header[32];
     uint32_t len;
     int ret = 0;
     FILE *cf;
 #endif
-    header_size = d86f_header_size(drive);
 
     if (! dev->f) return;
 
-    /* First write the track offsets table. */
+    thread_wait_mutex(dev->wb_mutex);
+
+#ifdef D86F_COMPRESS
     if (fseek(dev->f, 0, SEEK_SET) == -1)
-		fatal("86F write_back(): Error seeking to the beginning of the file\n");
-    if (fread(header, 1, header_size, dev->f) != header_size)
-		fatal("86F write_back(): Error reading header size\n");
+	fatal("86F write_back(): Error seeking to the beginning of the file\n");
+    if (fread(header, 1, 8, dev->f) != 8)
+	fatal("86F write_back(): Error reading header size\n");
+#endif
+
+    if (dev->table_dirty) {
+	if (fseek(dev->f, 8, SEEK_SET) == -1)
+		fatal("86F write_back(): Error seeking\n");
+	size = (dev->disk_flags & 8) ? 2048 : 1024;
+	if (fwrite(dev->track_offset, 1, size, dev->f) != size)
+		fatal("86F write_back(): Error writing data\n");
+	dev->table_dirty = 0;
+    }
 
-    if (fseek(dev->f, 8, SEEK_SET) == -1)
-	fatal("86F write_back(): Error seeking\n");
-    size = d86f_get_track_table_size(drive);
-    if (fwrite(dev->track_offset, 1, size, dev->f) != size)
-	fatal("86F write_back(): Error writing data\n");
+    for (i = 0; i < 512; i++) {
+	t = &dev->tracks[i];
+	if (!t->dirty || !dev->track_offset[i])
+		continue;
+
+	if (fseek(dev->f, dev->track_offset[i], SEEK_SET) == -1)
+		fatal("86F write_back(): Error seeking to track\n");
+	fwrite(&t->side_flags, 1, 2, dev->f);
+	if (dev->disk_flags & 0x80)
+		fwrite(&t->extra_bit_cells, 1, 4, dev->f);
+	fwrite(&t->index_hole_pos, 1, 4, dev->f);
+	fwrite(t->encoded_data, 1, t->size, dev->f);
+	if (dev->disk_flags & 1)
+		fwrite(t->surface_data, 1, t->size, dev->f);
+	t->dirty = 0;
+    }
 
-    d86f_write_tracks(drive, &dev->f, NULL);
+    fflush(dev->f);
 
 #ifdef D86F_COMPRESS
     if (dev->is_compressed) {
@@ -3149,13 +3344,13 @@ d86f_writeback(int drive)
 	cf = plat_fopen(dev->original_file_name, L"wb");
 
 	/* Write the header to the original file. */
-	fwrite(header, 1, header_size, cf);
+	fwrite(header, 1, 8, cf);
 
 	fseek(dev->f, 0, SEEK_END);
 	len = ftell(dev->f);
-	len -= header_size;
+	len -= 8;
 
-	fseek(dev->f, header_size, SEEK_SET);
+	fseek(dev->f, 8, SEEK_SET);
 
 	/* Compress data from the temporary uncompressed file to the original, compressed file. */
 	dev->filebuf = (uint8_t *) malloc(len);
@@ -3169,8 +3364,51 @@ d86f_writeback(int drive)
 	fwrite(dev->outbuf, 1, ret, cf);
 	free(dev->outbuf);
 	free(dev->filebuf);
+	fclose(cf);
     }
 #endif
+
+    thread_release_mutex(dev->wb_mutex);
+}
+
+
+/* Flushes the track cache in the background, so writes never stall the FDC. */
+static void
+d86f_writeback_thread(void *param)
+{
+    d86f_t *dev = (d86f_t *) param;
+
+    while (dev->wb_run) {
+	thread_wait_event(dev->wb_event, -1);
+	thread_reset_event(dev->wb_event);
+
+	d86f_flush(dev);
+    }
+}
+
+
+void
+d86f_writeback(int drive)
+{
+    d86f_t *dev = d86f[drive];
+
+    if (! dev->f) return;
+
+    if (dev->tracks == NULL) {
+	/* No cache, write everything out right away. */
+	if (fseek(dev->f, 8, SEEK_SET) == -1)
+		fatal("86F write_back(): Error seeking\n");
+	if (fwrite(dev->track_offset, 1, d86f_get_track_table_size(drive), dev->f) != d86f_get_track_table_size(drive))
+		fatal("86F write_back(): Error writing data\n");
+
+	d86f_write_tracks(drive, &dev->f, NULL);
+	return;
+    }
+
+    d86f_write_tracks(drive, &dev->f, NULL);
+
+    dev->table_dirty = 1;
+    thread_set_event(dev->wb_event);
 }
 
 
@@ -3311,7 +3549,11 @@ d86f_add_track(int drive, int track, int side)
 
     if (! dev->track_offset[logical_track]) {
 	/* Track is absent from the file, let's add it. */
+	if (dev->wb_mutex)
+		thread_wait_mutex(dev->wb_mutex);
 	dev->track_offset[logical_track] = dev->file_size;
+	if (dev->wb_mutex)
+		thread_release_mutex(dev->wb_mutex);
 
 	dev->file_size += (array_size + 6);
 	if (d86f_has_extra_bit_cells(drive))
@@ -3796,6 +4038,16 @@ d86f_load(int drive, wchar_t *fn)
 
     d86f_register_86f(drive);
 
+    /* Tracks are read lazily into the cache and written back in the background. */
+    dev->tracks = (d86f_track_t *) calloc(512, sizeof(d86f_track_t));
+    if (dev->tracks != NULL) {
+	dev->table_dirty = 0;
+	dev->wb_mutex = thread_create_mutex();
+	dev->wb_event = thread_create_event();
+	dev->wb_run = 1;
+	dev->wb_thread = thread_create(d86f_writeback_thread, dev);
+    }
+
     drives[drive].seek = d86f_seek;
     d86f_common_handlers(drive);
     drives[drive].format = d86f_format;
@@ -3861,6 +4113,21 @@ d86f_close(int drive)
 	}
     }
 
+    if (dev->wb_thread) {
+	dev->wb_run = 0;
+	thread_set_event(dev->wb_event);
+	thread_wait(dev->wb_thread, -1);
+	dev->wb_thread = NULL;
+
+	d86f_flush(dev);
+
+	thread_destroy_event(dev->wb_event);
+	dev->wb_event = NULL;
+	thread_close_mutex(dev->wb_mutex);
+	dev->wb_mutex = NULL;
+    }
+    d86f_cache_close(dev);
+
     if (dev->f) {
 	fclose(dev->f);
 	dev->f = NULL;
@@ -105,6 +105,7 @@ extern uint32_t	mem_size;			/* (C) memory size */
 extern int	cpu_manufacturer,		/* (C) cpu manufacturer */
 		cpu,				/* (C) cpu type */
 		cpu_use_dynarec,		/* (C) cpu uses/needs Dyna */
+		cpu_idle_skip,			/* (C) skip idle polling loops */
 		fpu_type;			/* (C) fpu type */
 extern int	time_sync;			/* (C) enable time sync */
 extern int	network_type;			/* (C) net provider type */
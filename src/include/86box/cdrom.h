@@ -85,6 +85,7 @@ typedef struct {
     void	(*get_subchannel)(struct cdrom *dev, uint32_t lba, subchannel_t *subc);
     int		(*sector_size)(struct cdrom *dev, uint32_t lba);
     int		(*read_sector)(struct cdrom *dev, int type, uint8_t *b, uint32_t lba);
+    int		(*read_sectors)(struct cdrom *dev, int type, uint8_t *b, uint32_t lba, uint32_t num);
     int		(*track_type)(struct cdrom *dev, uint32_t lba);
     void	(*exit)(struct cdrom *dev);
 } cdrom_ops_t;
@@ -112,7 +113,8 @@ typedef struct cdrom {
 	     seek_diff, cd_end;
 
     int host_drive, prev_host_drive,
-	cd_buflen, noplay;
+	cd_buflen, noplay,
+	readahead;		/* Image read-ahead, in sectors. */
 
     const cdrom_ops_t	*ops;
 
@@ -132,6 +134,7 @@ extern cdrom_t	cdrom[CDROM_NUM];
 extern int	cdrom_lba_to_msf_accurate(int lba);
 extern double	cdrom_seek_time(cdrom_t *dev);
 extern void	cdrom_stop(cdrom_t *dev);
+extern void	cdrom_audio_prefetch(cdrom_t *dev);
 extern int	cdrom_audio_callback(cdrom_t *dev, int16_t *output, int len);
 extern uint8_t	cdrom_audio_play(cdrom_t *dev, uint32_t pos, uint32_t len, int ismsf);
 extern uint8_t	cdrom_audio_track_search(cdrom_t *dev, uint32_t pos, int type, uint8_t playbit);
@@ -143,6 +146,7 @@ extern int	cdrom_read_toc(cdrom_t *dev, unsigned char *b, int type,
 			       unsigned char start_track, int msf, int max_len);
 extern int	cdrom_readsector_raw(cdrom_t *dev, uint8_t *buffer, int sector, int ismsf,
 				     int cdrom_sector_type, int cdrom_sector_flags, int *len);
+extern int	cdrom_readsectors_cooked(cdrom_t *dev, uint8_t *buffer, uint32_t lba, int num);
 extern void 	cdrom_read_disc_info_toc(cdrom_t *dev, unsigned char *b, unsigned char track, int type);
 
 extern void	cdrom_seek(cdrom_t *dev, uint32_t pos);
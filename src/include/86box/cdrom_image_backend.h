@@ -25,6 +25,9 @@
 #define RAW_SECTOR_SIZE		2352
 #define COOKED_SECTOR_SIZE	2048
 
+#define CDI_READAHEAD_DEFAULT	32	/* Sectors, 0 disables the cache. */
+#define CDI_READAHEAD_MAX	256
+
 #define DATA_TRACK		0x14
 #define AUDIO_TRACK		0x10
 
@@ -54,6 +57,7 @@ typedef struct {
 
     wchar_t		fn[260];
     FILE		*file;
+    void		*priv;
 } track_file_t;
 
 typedef struct {
@@ -67,11 +71,23 @@ typedef struct {
 typedef struct {
     int			tracks_num;
     track_t		*tracks;
+
+    /* Index of the track last returned by cdi_get_track(). */
+    int			last_track;
+
+    /* Read-ahead cache, holds whole sectors in the native format of
+       the track they were read from. */
+    int			ra_track;
+    uint32_t		ra_size, ra_start,
+			ra_count;
+    uint8_t		*ra_buf;
+    void		*ra_mutex;
 } cd_img_t;
 
 
 /* Binary file functions. */
 extern void	cdi_close(cd_img_t *cdi);
+extern void	cdi_set_readahead(cd_img_t *cdi, uint32_t sectors);
 extern int	cdi_set_device(cd_img_t *cdi, const wchar_t *path);
 extern int	cdi_get_audio_tracks(cd_img_t *cdi, int *st_track, int *end, TMSF *lead_out);
 extern int	cdi_get_audio_tracks_lba(cd_img_t *cdi, int *st_track, int *end, uint32_t *lead_out);
@@ -87,9 +103,14 @@ extern int	cdi_is_mode2(cd_img_t *cdi, uint32_t sector);
 extern int	cdi_get_mode2_form(cd_img_t *cdi, uint32_t sector);
 extern int	cdi_load_iso(cd_img_t *cdi, const wchar_t *filename);
 extern int	cdi_load_cue(cd_img_t *cdi, const wchar_t *cuefile);
+extern int	cdi_load_chd(cd_img_t *cdi, const wchar_t *filename);
 extern int	cdi_has_data_track(cd_img_t *cdi);
 extern int	cdi_has_audio_track(cd_img_t *cdi);
 
 
+/* Compressed (CHD) file functions. */
+extern track_file_t	*chd_init(const wchar_t *filename, int *error);
+extern int		chd_get_track(track_file_t *tf, int track, track_t *trk);
+
 
 #endif /* ! CDROM_IMAGE_BACKEND_H */
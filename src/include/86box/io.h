@@ -70,6 +70,8 @@ extern void	io_removehandler_interleaved(uint16_t base, int size,
 			void *priv);
 #endif
 
+extern uint32_t	io_write_count;
+
 extern uint8_t	inb(uint16_t port);
 extern void	outb(uint16_t port, uint8_t  val);
 extern uint16_t	inw(uint16_t port);
@@ -197,6 +197,7 @@ extern uint32_t	dp8390_read_cr(dp8390_t *dev);
 extern void	dp8390_write_cr(dp8390_t *dev, uint32_t val);
 
 extern void	dp8390_rx(void *priv, uint8_t *buf, int io_len);
+extern int	dp8390_wait(void *priv);
 
 extern uint32_t	dp8390_page0_read(dp8390_t *dev, uint32_t off, unsigned int len);
 extern void	dp8390_page0_write(dp8390_t *dev, uint32_t off, uint32_t val, unsigned len);
@@ -53,6 +53,17 @@
 #define NET_TYPE_NONE	0		/* networking disabled */
 #define NET_TYPE_PCAP	1		/* use the (Win)Pcap API */
 #define NET_TYPE_SLIRP	2		/* use the SLiRP port forwarder */
+#define NET_TYPE_VLAN	3		/* use a local shared-memory VLAN */
+#define NET_TYPE_REFLECT 4		/* reflect frames back, for benchmarks */
+
+/* Link speed models for delivering received frames to the card. */
+#define NET_SPEED_10M	0		/* 10 Mbit/s */
+#define NET_SPEED_100M	1		/* 100 Mbit/s */
+#define NET_SPEED_MAX	2		/* as fast as the card takes them */
+
+/* Frame directions for the capture file. */
+#define NET_CAPTURE_IN	1		/* received by the card */
+#define NET_CAPTURE_OUT	2		/* sent by the card */
 
 /* Supported network cards. */
 enum {
@@ -69,12 +80,16 @@ typedef int (*NETWAITCB)(void *);
 typedef int (*NETSETLINKSTATE)(void *);
 
 
+#define NET_PKT_SLOT	1536		/* Largest frame kept in a queue slot. */
+#define NET_QUEUE_LEN	512		/* Slots per direction; a power of two. */
+
+
 typedef struct netpkt {
     void		*priv;
-    uint8_t		data[65536];	/* Maximum length + 1 to round up to the nearest power of 2. */
+    uint8_t		*data;		/* Either buf, or malloc'ed for larger frames. */
     int			len;
 
-    struct netpkt	*prev, *next;
+    uint8_t		buf[NET_PKT_SLOT];
 } netpkt_t;
 
 typedef struct {
@@ -102,6 +117,11 @@ extern "C" {
 extern int	nic_do_log;				/* config */
 extern int      network_ndev;
 extern int	network_rx_pause;
+extern int	network_speed;				/* config */
+extern int	network_capture;			/* config */
+extern int	network_reflect_size;			/* config */
+extern int	network_reflect_rate;			/* config */
+extern char	network_vlan[64];			/* config */
 extern netdev_t network_devs[32];
 
 
@@ -130,6 +150,23 @@ extern int	net_slirp_init(void);
 extern int	net_slirp_reset(const netcard_t *, uint8_t *);
 extern void	net_slirp_close(void);
 extern void	net_slirp_in(uint8_t *, int);
+extern void	net_slirp_wake(void);
+
+extern int	net_vlan_init(void);
+extern int	net_vlan_reset(const netcard_t *, uint8_t *);
+extern void	net_vlan_close(void);
+extern void	net_vlan_in(uint8_t *, int);
+
+extern int	net_reflect_init(void);
+extern int	net_reflect_reset(const netcard_t *, uint8_t *);
+extern void	net_reflect_close(void);
+extern void	net_reflect_in(uint8_t *, int);
+extern void	net_reflect_rx_done(int);
+
+extern void	network_capture_packet(int dir, uint8_t *data, int len);
+extern void	network_capture_start(void);
+extern void	network_capture_stop(void);
+extern void	network_capture_enable(int on);
 
 extern int	network_dev_to_id(char *);
 extern int	network_card_available(int);
@@ -144,7 +181,7 @@ extern int	network_get_wait(void);
 
 extern void	network_timer_stop(void);
 
-extern void	network_queue_put(int tx, void *priv, uint8_t *data, int len);
+extern int	network_queue_put(int tx, void *priv, uint8_t *data, int len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,43 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Definitions for the shared stereo sample rate converter.
+ */
+#ifndef SOUND_RESAMPLER_H
+# define SOUND_RESAMPLER_H
+
+
+/* Quality levels, see sound_resample_quality. */
+#define RESAMPLER_LINEAR	0	/* Linear interpolation. */
+#define RESAMPLER_LOW		1	/* 8-tap windowed sinc. */
+#define RESAMPLER_MEDIUM	2	/* 16-tap windowed sinc. */
+#define RESAMPLER_HIGH		3	/* 32-tap windowed sinc. */
+
+
+typedef struct resampler_t resampler_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns NULL if out of memory. */
+extern resampler_t *	resampler_init(uint32_t in_rate, uint32_t out_rate, int quality);
+extern void		resampler_close(resampler_t *rs);
+
+/* Produce num stereo frames into out, calling gen(priv, frame) for every
+   stereo input frame that is needed. */
+extern void		resampler_run(resampler_t *rs, int32_t *out, uint32_t num,
+				      void (*gen)(void *priv, int32_t *frame), void *priv);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif	/*SOUND_RESAMPLER_H*/
@@ -285,6 +285,7 @@
 #define IDM_CONFIG_LOAD		40021
 #define IDM_CONFIG_SAVE		40022
 #define IDM_UPDATE_ICONS	40030
+#define IDM_NET_CAPTURE		40031
 #define IDM_VID_RESIZE		40040
 #define IDM_VID_REMEMBER	40041
 #define IDM_VID_SDL_SW		40050
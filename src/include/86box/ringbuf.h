@@ -0,0 +1,151 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Lock-free ring buffer of fixed-size elements, for exactly one
+ *		producer thread and one consumer thread.
+ *
+ *		The producer only ever moves the tail and the consumer only
+ *		ever moves the head, so no locking is needed; the element
+ *		count must be a power of two.
+ */
+#ifndef EMU_RINGBUF_H
+# define EMU_RINGBUF_H
+
+
+typedef struct {
+    uint8_t	*buf;
+    uint32_t	elem_size,
+		count;
+    uint32_t	head,		/* Next element to read. */
+		tail;		/* Next element to write. */
+} ringbuf_t;
+
+
+static inline int
+ringbuf_init(ringbuf_t *rb, uint32_t elem_size, uint32_t count)
+{
+    rb->buf = (uint8_t *) malloc(elem_size * count);
+    rb->elem_size = elem_size;
+    rb->count = count;
+    rb->head = rb->tail = 0;
+
+    return (rb->buf != NULL);
+}
+
+
+static inline void
+ringbuf_close(ringbuf_t *rb)
+{
+    if (rb->buf != NULL)
+	free(rb->buf);
+    rb->buf = NULL;
+}
+
+
+/* Number of elements waiting to be read; safe from either side. */
+static inline uint32_t
+ringbuf_used(ringbuf_t *rb)
+{
+    return __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE) -
+	   __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+}
+
+
+/* Producer: slot for the next element, or NULL if the ring is full. */
+static inline void *
+ringbuf_write_ptr(ringbuf_t *rb)
+{
+    uint32_t head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+
+    if ((rb->tail - head) >= rb->count)
+	return NULL;
+
+    return &rb->buf[(rb->tail & (rb->count - 1)) * rb->elem_size];
+}
+
+
+/* Producer: publish the element filled in through ringbuf_write_ptr(). */
+static inline void
+ringbuf_write_commit(ringbuf_t *rb)
+{
+    __atomic_store_n(&rb->tail, rb->tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Consumer: oldest element, or NULL if the ring is empty. */
+static inline void *
+ringbuf_read_ptr(ringbuf_t *rb)
+{
+    uint32_t tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+
+    if (tail == rb->head)
+	return NULL;
+
+    return &rb->buf[(rb->head & (rb->count - 1)) * rb->elem_size];
+}
+
+
+/* Consumer: release the element returned by ringbuf_read_ptr(). */
+static inline void
+ringbuf_read_commit(ringbuf_t *rb)
+{
+    __atomic_store_n(&rb->head, rb->head + 1, __ATOMIC_RELEASE);
+}
+
+
+/* Producer: copy in up to num elements, returns how many fit. */
+static inline uint32_t
+ringbuf_write(ringbuf_t *rb, const void *src, uint32_t num)
+{
+    uint32_t head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+    uint32_t pos = rb->tail & (rb->count - 1);
+    uint32_t n, first;
+
+    n = rb->count - (rb->tail - head);
+    if (num < n)
+	n = num;
+
+    first = rb->count - pos;
+    if (first > n)
+	first = n;
+
+    memcpy(&rb->buf[pos * rb->elem_size], src, first * rb->elem_size);
+    memcpy(rb->buf, ((const uint8_t *) src) + (first * rb->elem_size), (n - first) * rb->elem_size);
+
+    __atomic_store_n(&rb->tail, rb->tail + n, __ATOMIC_RELEASE);
+
+    return n;
+}
+
+
+/* Consumer: copy out up to num elements, returns how many were read. */
+static inline uint32_t
+ringbuf_read(ringbuf_t *rb, void *dest, uint32_t num)
+{
+    uint32_t tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+    uint32_t pos = rb->head & (rb->count - 1);
+    uint32_t n, first;
+
+    n = tail - rb->head;
+    if (num < n)
+	n = num;
+
+    first = rb->count - pos;
+    if (first > n)
+	first = n;
+
+    memcpy(dest, &rb->buf[pos * rb->elem_size], first * rb->elem_size);
+    memcpy(((uint8_t *) dest) + (first * rb->elem_size), rb->buf, (n - first) * rb->elem_size);
+
+    __atomic_store_n(&rb->head, rb->head + n, __ATOMIC_RELEASE);
+
+    return n;
+}
+
+
+#endif	/*EMU_RINGBUF_H*/
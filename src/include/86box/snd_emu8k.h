@@ -343,6 +343,9 @@ typedef struct emu8k_voice_t
 
 } emu8k_voice_t;
 
+/* Input frames the resampler may leave unconsumed at the end of a block. */
+#define EMU8K_CARRY 8
+
 typedef struct emu8k_t
 {
         emu8k_voice_t voice[32];
@@ -377,6 +380,14 @@ typedef struct emu8k_t
         
         int pos;
         int32_t buffer[SOUNDBUFLEN * 2];
+
+        /* The chip runs at 44.1 kHz, this is buffer converted to 48 kHz. */
+        struct resampler_t *rs;
+        int read_pos;
+        int32_t carry[EMU8K_CARRY * 2];     /* Frames left over from the previous block. */
+        int carry_len, carry_pos;
+        int32_t last[2];
+        int32_t resampled[SOUNDBUFLEN * 2];
 } emu8k_t;
 
 
@@ -385,6 +396,7 @@ void emu8k_init(emu8k_t *emu8k, uint16_t emu_addr, int onboard_ram);
 void emu8k_close(emu8k_t *emu8k);
 
 void emu8k_update(emu8k_t *emu8k);
+void emu8k_resample(emu8k_t *emu8k, int len);
 
 
 
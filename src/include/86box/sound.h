@@ -21,6 +21,9 @@
 
 
 extern int sound_gain;
+extern int sound_sync;
+extern int sound_resample_quality;
+extern int sound_capture;
 
 #define SOUNDBUFLEN	(48000/50)
 
@@ -48,6 +51,31 @@ extern void	sound_add_handler(void (*get_buffer)(int32_t *buffer, \
 extern void	sound_set_cd_audio_filter(void (*filter)(int channel, \
 					  double *buffer, void *p), void *p);
 
+extern void	sound_mix_add(int32_t *dst, const int32_t *src, int len);
+extern void	sound_mix_add_int16_half(int32_t *dst, const int16_t *src, int len);
+extern void	sound_mix_add_int16_planar(int32_t *dst, const int16_t *l,
+					   const int16_t *r, int len);
+extern void	sound_mix_to_int16(int16_t *dst, const int32_t *src, int len);
+extern void	sound_mix_to_float(float *dst, const int32_t *src, int len);
+
+/* Capture taps and the sample formats they can be fed. */
+enum {
+    SOUND_CAPTURE_MIX = 0,
+    SOUND_CAPTURE_CD,
+    SOUND_CAPTURE_MIDI,
+    SOUND_CAPTURE_MAX
+};
+
+enum {
+    SOUND_CAPTURE_INT32 = 0,
+    SOUND_CAPTURE_INT16,
+    SOUND_CAPTURE_FLOAT
+};
+
+extern void	sound_capture_init(void);
+extern void	sound_capture_close(void);
+extern void	sound_capture_write(int tap, int fmt, const void *buf, int frames, int rate);
+
 extern int	sound_card_available(int card);
 extern char	*sound_card_getname(int card);
 #ifdef EMU_DEVICE_H
@@ -66,6 +94,7 @@ extern void	sound_reset(void);
 
 extern void	sound_card_reset(void);
 
+extern void	sound_thread_end(void);
 extern void	sound_cd_thread_end(void);
 extern void	sound_cd_thread_reset(void);
 
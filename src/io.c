@@ -50,6 +50,7 @@ typedef struct _io_ {
 
 int initialized = 0;
 io_t *io[NPORTS], *io_last[NPORTS];
+uint32_t io_write_count = 0;	/* Port writes so far, for the idle loop detector. */
 
 
 #ifdef ENABLE_IO_LOG
@@ -322,6 +323,8 @@ outb(uint16_t port, uint8_t val)
     int found = 0;
     int qfound = 0;
 
+    io_write_count++;
+
     p = io[port];
     while(p) {
 	q = p->next;
@@ -408,6 +411,8 @@ outw(uint16_t port, uint16_t val)
     int qfound = 0;
     int i = 0;
 
+    io_write_count++;
+
     p = io[port];
     while(p) {
 	q = p->next;
@@ -526,6 +531,8 @@ outl(uint16_t port, uint32_t val)
     int qfound = 0;
     int i = 0;
 
+    io_write_count++;
+
     p = io[port];
     if (p) {
 	while(p) {
@@ -0,0 +1,299 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Capture of the emulated network traffic to pcapng files.
+ *
+ *		Frames are stamped and copied into a ring on the emulation
+ *		thread, which both receives and sends them; a writer thread
+ *		formats the pcapng blocks and does all the file I/O. Each
+ *		frame carries the host time as its timestamp, the emulated
+ *		time in a comment, and its direction in the flags word.
+ */
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <sys/time.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/timer.h>
+#include <86box/plat.h>
+#include <86box/ringbuf.h>
+#include <86box/network.h>
+
+
+#define CAPTURE_RING	512		/* Frames; a power of two. */
+
+/* pcapng block types and options. */
+#define PCAPNG_SHB	0x0a0d0d0a
+#define PCAPNG_IDB	0x00000001
+#define PCAPNG_EPB	0x00000006
+#define PCAPNG_MAGIC	0x1a2b3c4d
+#define OPT_ENDOFOPT	0
+#define OPT_COMMENT	1
+#define OPT_EPB_FLAGS	2
+#define OPT_IF_TSRESOL	9
+#define LINKTYPE_ETH	1
+
+
+typedef struct {
+    uint64_t	host_ns,
+		emu_ns;
+    uint32_t	dir,
+		len;		/* Length on the wire; at most NET_PKT_SLOT is kept. */
+    uint8_t	data[NET_PKT_SLOT];
+} capture_frame_t;
+
+
+int		network_capture = 0;
+
+static ringbuf_t	capture_ring;
+static thread_t		*capture_thread_h = NULL;
+static event_t		*capture_event = NULL;
+static volatile int	capture_on = 0;
+static FILE		*capture_f = NULL;
+static uint32_t		capture_dropped;
+static uint8_t		capture_block[NET_PKT_SLOT + 128];
+
+
+#ifdef ENABLE_NET_CAPTURE_LOG
+int net_capture_do_log = ENABLE_NET_CAPTURE_LOG;
+
+
+static void
+net_capture_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (net_capture_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define net_capture_log(fmt, ...)
+#endif
+
+
+static uint8_t *
+capture_put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+
+static uint8_t *
+capture_put16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, 2);
+    return p + 2;
+}
+
+
+/* Append an option, padded to 32 bits. */
+static uint8_t *
+capture_put_opt(uint8_t *p, uint16_t code, const void *data, uint16_t len)
+{
+    p = capture_put16(p, code);
+    p = capture_put16(p, len);
+    if (len)
+	memcpy(p, data, len);
+    memset(p + len, 0x00, (4 - (len & 3)) & 3);
+
+    return p + ((len + 3) & ~3);
+}
+
+
+/* Fill in the length fields of the block built in capture_block and write it. */
+static void
+capture_write_block(uint8_t *end)
+{
+    uint32_t len = (end - capture_block) + 4;
+
+    capture_put32(&capture_block[4], len);
+    capture_put32(end, len);
+
+    fwrite(capture_block, 1, len, capture_f);
+}
+
+
+static void
+capture_open(void)
+{
+    wchar_t path[1024], fn[128];
+    uint8_t *p, tsresol = 9;
+
+    plat_append_filename(path, usr_path, L"capture");
+    if (! plat_dir_check(path))
+	plat_dir_create(path);
+    plat_path_slash(path);
+
+    plat_tempfile(fn, L"network", L".pcapng");
+    wcscat(path, fn);
+
+    capture_f = plat_fopen(path, L"wb");
+    if (capture_f == NULL) {
+	net_capture_log("Network capture: unable to create %ls\n", path);
+	return;
+    }
+
+    /* Section header: version 1.0, section length unknown. */
+    p = capture_put32(capture_block, PCAPNG_SHB);
+    p = capture_put32(p, 0);
+    p = capture_put32(p, PCAPNG_MAGIC);
+    p = capture_put16(p, 1);
+    p = capture_put16(p, 0);
+    p = capture_put32(p, 0xffffffff);
+    p = capture_put32(p, 0xffffffff);
+    capture_write_block(p);
+
+    /* One Ethernet interface, with nanosecond timestamps. */
+    p = capture_put32(capture_block, PCAPNG_IDB);
+    p = capture_put32(p, 0);
+    p = capture_put16(p, LINKTYPE_ETH);
+    p = capture_put16(p, 0);
+    p = capture_put32(p, NET_PKT_SLOT);
+    p = capture_put_opt(p, OPT_IF_TSRESOL, &tsresol, 1);
+    p = capture_put_opt(p, OPT_ENDOFOPT, NULL, 0);
+    capture_write_block(p);
+}
+
+
+static void
+capture_write_frame(capture_frame_t *fr)
+{
+    uint32_t caplen = (fr->len > NET_PKT_SLOT) ? NET_PKT_SLOT : fr->len;
+    char comment[64];
+    uint8_t *p;
+
+    p = capture_put32(capture_block, PCAPNG_EPB);
+    p = capture_put32(p, 0);
+    p = capture_put32(p, 0);				/* Interface */
+    p = capture_put32(p, fr->host_ns >> 32);
+    p = capture_put32(p, fr->host_ns & 0xffffffff);
+    p = capture_put32(p, caplen);
+    p = capture_put32(p, fr->len);
+    memcpy(p, fr->data, caplen);
+    memset(p + caplen, 0x00, (4 - (caplen & 3)) & 3);
+    p += (caplen + 3) & ~3;
+
+    /* Inbound is 1 and outbound is 2 in the low bits of the flags. */
+    p = capture_put_opt(p, OPT_EPB_FLAGS, &fr->dir, 4);
+    sprintf(comment, "emulated time %" PRIu64 ".%09" PRIu64,
+	    (uint64_t) (fr->emu_ns / 1000000000ULL), (uint64_t) (fr->emu_ns % 1000000000ULL));
+    p = capture_put_opt(p, OPT_COMMENT, comment, strlen(comment));
+    p = capture_put_opt(p, OPT_ENDOFOPT, NULL, 0);
+
+    capture_write_block(p);
+}
+
+
+static void
+capture_thread(void *param)
+{
+    capture_frame_t *fr;
+    int on;
+
+    capture_open();
+
+    do {
+	thread_wait_event(capture_event, 100);
+	thread_reset_event(capture_event);
+
+	on = capture_on;
+
+	while ((fr = (capture_frame_t *) ringbuf_read_ptr(&capture_ring)) != NULL) {
+		if (capture_f != NULL)
+			capture_write_frame(fr);
+		ringbuf_read_commit(&capture_ring);
+	}
+    } while (on);
+
+    if (capture_f != NULL) {
+	fclose(capture_f);
+	capture_f = NULL;
+    }
+}
+
+
+/* Queue a frame for the capture file; called on the emulation thread. */
+void
+network_capture_packet(int dir, uint8_t *data, int len)
+{
+    capture_frame_t *fr;
+    struct timeval tv;
+
+    if (!capture_on)
+	return;
+
+    fr = (capture_frame_t *) ringbuf_write_ptr(&capture_ring);
+    if (fr == NULL) {
+	capture_dropped++;
+	thread_set_event(capture_event);
+	return;
+    }
+
+    gettimeofday(&tv, NULL);
+    fr->host_ns = ((uint64_t) tv.tv_sec * 1000000000ULL) + ((uint64_t) tv.tv_usec * 1000ULL);
+    fr->emu_ns = TIMER_USEC ? (uint64_t) (((double) tsc * 4294967296.0 * 1000.0) / (double) TIMER_USEC) : 0;
+    fr->dir = dir;
+    fr->len = len;
+    memcpy(fr->data, data, (len > NET_PKT_SLOT) ? NET_PKT_SLOT : len);
+
+    ringbuf_write_commit(&capture_ring);
+
+    if (ringbuf_used(&capture_ring) >= (CAPTURE_RING / 2))
+	thread_set_event(capture_event);
+}
+
+
+/*
+ * Start capturing to a new file. Like network_capture_stop(), this must
+ * not run while the emulation thread can be sending or receiving.
+ */
+void
+network_capture_start(void)
+{
+    if (capture_on)
+	return;
+
+    if (! ringbuf_init(&capture_ring, sizeof(capture_frame_t), CAPTURE_RING))
+	return;
+
+    capture_dropped = 0;
+    capture_on = 1;
+    capture_event = thread_create_event();
+    capture_thread_h = thread_create(capture_thread, NULL);
+}
+
+
+void
+network_capture_stop(void)
+{
+    if (!capture_on)
+	return;
+
+    capture_on = 0;
+    thread_set_event(capture_event);
+    thread_wait(capture_thread_h, -1);
+    capture_thread_h = NULL;
+
+    thread_destroy_event(capture_event);
+    capture_event = NULL;
+
+    if (capture_dropped)
+	net_capture_log("Network capture: dropped %u frames\n", capture_dropped);
+
+    ringbuf_close(&capture_ring);
+}
@@ -93,6 +93,7 @@ uint32_t
 dp8390_chipmem_read(dp8390_t *dev, uint32_t addr, unsigned int len)
 {
     int i;
+    uint8_t *p;
     uint32_t retval = 0;
 
 #ifdef ENABLE_DP8390_LOG
@@ -102,6 +103,20 @@ dp8390_chipmem_read(dp8390_t *dev, uint32_t addr, unsigned int len)
 
     dp8390_log("DP8390: Chipmem Read Address=%04x\n", addr);
 
+    /* Remote DMA data port accesses nearly always fall inside the buffer
+       memory, so take those without going byte by byte. */
+    if ((addr >= dev->mem_start) && ((addr + len) <= dev->mem_end)) {
+	p = &dev->mem[addr - dev->mem_start];
+	switch (len) {
+		case 1:
+			return(p[0]);
+		case 2:
+			return(p[0] | (p[1] << 8));
+		case 4:
+			return(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+	}
+    }
+
     /* ROM'd MAC address */
     for (i = 0; i < len; i++) {
 	if ((addr >= dev->mem_start) && (addr < dev->mem_end))
@@ -123,6 +138,7 @@ void
 dp8390_chipmem_write(dp8390_t *dev, uint32_t addr, uint32_t val, unsigned len)
 {
     int i;
+    uint8_t *p;
 
 #ifdef ENABLE_DP8390_LOG
     if ((len > 1) && (addr & (len - 1))
@@ -131,6 +147,22 @@ dp8390_chipmem_write(dp8390_t *dev, uint32_t addr, uint32_t val, unsigned len)
 
     dp8390_log("DP8390: Chipmem Write Address=%04x\n", addr);
 
+    if ((addr >= dev->mem_start) && ((addr + len) <= dev->mem_end)) {
+	p = &dev->mem[addr - dev->mem_start];
+	switch (len) {
+		case 4:
+			p[3] = (val >> 24) & 0xff;
+			p[2] = (val >> 16) & 0xff;
+			/*FALLTHROUGH*/
+		case 2:
+			p[1] = (val >> 8) & 0xff;
+			/*FALLTHROUGH*/
+		case 1:
+			p[0] = val & 0xff;
+			return;
+	}
+    }
+
     for (i = 0; i < len; i++) {
 	if ((addr < dev->mem_start) || (addr >= dev->mem_end)) {
 		dp8390_log("DP8390: out-of-bounds chipmem write, %04X\n", addr);
@@ -410,6 +442,36 @@ dp8390_rx(void *priv, uint8_t *buf, int io_len)
 }
 
 
+/*
+ * Called by the network layer to see whether it should hold off on
+ * further frames: returns nonzero while the RX ring could not take a
+ * maximum-sized one. A stopped receiver drops frames anyway, so it
+ * never asks to wait.
+ */
+int
+dp8390_wait(void *priv)
+{
+    dp8390_t *dev = (dp8390_t *)priv;
+    int pages, avail;
+
+    if ((dev->CR.stop != 0) || (dev->page_start == 0)) return(0);
+
+    pages = (1514 + 4 + sizeof(uint32_t) + 255)/256;
+    if (dev->curr_page < dev->bound_ptr) {
+	avail = dev->bound_ptr - dev->curr_page;
+    } else {
+	avail = (dev->page_stop - dev->page_start) -
+		(dev->curr_page - dev->bound_ptr);
+    }
+
+#if DP8390_NEVER_FULL_RING
+    return(avail <= pages);
+#else
+    return(avail < pages);
+#endif
+}
+
+
 /* Handle reads/writes to the 'zeroth' page of the DS8390 register file. */
 uint32_t
 dp8390_page0_read(dp8390_t *dev, uint32_t off, unsigned int len)
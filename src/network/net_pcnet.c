@@ -427,7 +427,9 @@ pcnetIsLinkUp(nic_t *dev)
 
 /**
  * Load transmit message descriptor
- * Make sure we read the own flag first.
+ * Make sure we read the own flag first: descriptors are also polled from the
+ * network provider threads (through pcnetWaitReceiveAvail()) while the guest
+ * is running and filling them in, so the rest is only valid once we own it.
  *
  * @param pThis         adapter private data
  * @param addr          physical address of the descriptor
@@ -536,7 +538,7 @@ pcnetTmdStorePassHost(nic_t *dev, TMD *tmd, uint32_t addr)
 
 /**
  * Load receive message descriptor
- * Make sure we read the own flag first.
+ * Make sure we read the own flag first, see pcnetTmdLoad().
  *
  * @param pThis         adapter private data
  * @param addr          physical address of the descriptor
@@ -1187,54 +1189,6 @@ pcnetTdtePoll(nic_t *dev, TMD *tmd)
 }
 
 
-/**
- * Poll Transmit Descriptor Table Entry
- * @return true if transmit descriptors available
- */
-static int 
-pcnetCalcPacketLen(nic_t *dev, int cb)
-{
-    TMD tmd;
-    int cbPacket = cb;
-    uint32_t iDesc = CSR_XMTRC(dev);
-    uint32_t iFirstDesc = iDesc;
-
-    do
-    {
-        /* Advance the ring counter */
-        if (iDesc < 2)
-            iDesc = CSR_XMTRL(dev);
-        else
-            iDesc--;
-
-        if (iDesc == iFirstDesc)
-            break;
-
-        uint32_t addrDesc = pcnetTdraAddr(dev, iDesc);
-
-        if (!pcnetTmdLoad(dev, &tmd, PHYSADDR(dev, addrDesc), 1)) {
-            /*
-             * No need to count further since this packet won't be sent anyway
-             * due to underflow.
-             */
-            pcnetlog(3, "%s: pcnetCalcPacketLen: underflow, return %u\n", dev->name, cbPacket);
-            return cbPacket;
-        }
-        if (tmd.tmd1.ones != 15) {
-            pcnetlog(1, "%s: BAD TMD XDA=%#010x\n",
-                    dev->name, PHYSADDR(dev, addrDesc));
-            pcnetlog(3, "%s: pcnetCalcPacketLen: bad TMD, return %u\n", dev->name, cbPacket);
-            return cbPacket;
-        }
-        pcnetlog(3, "%s: pcnetCalcPacketLen: got valid TMD, cb=%u\n", dev->name, 4096 - tmd.tmd1.bcnt);
-        cbPacket += 4096 - tmd.tmd1.bcnt;
-    } while (!tmd.tmd1.enp);
-
-    pcnetlog(3, "#%d pcnetCalcPacketLen: return %u\n", dev->name, cbPacket);
-    return cbPacket;
-}
-
-
 /**
  * Write data into guest receive buffers.
  */
@@ -1282,16 +1236,7 @@ pcnetReceiveNoSync(void *priv, uint8_t *buf, int size)
 
         if (HOST_IS_OWNER(CSR_CRST(dev))) {
             /* Not owned by controller. This should not be possible as
-             * we already called pcnetCanReceive(). */			
-	    const unsigned cb = 1 << dev->iLog2DescSize;
-            uint32_t GCPhys = dev->GCRDRA;
-            iRxDesc = CSR_RCVRL(dev);
-
-            while (iRxDesc-- > 0) {
-                RMD rmd;
-                pcnetRmdLoad(dev, &rmd, PHYSADDR(dev, GCPhys), 0);
-                GCPhys += cb;
-            }
+             * we already called pcnetCanReceive(). */
             dev->aCSR[0] |= 0x1000; /* Set MISS flag */
             CSR_MISSC(dev)++;
 	    pcnetlog(2, "%s: pcnetReceiveNoSync: packet missed\n", dev->name);
@@ -1595,14 +1540,13 @@ pcnetAsyncTransmit(nic_t *dev)
 	    }
         } else if (tmd.tmd1.stp) {
             /*
-             * Read TMDs until end-of-packet or tdte poll fails (underflow).
-             *
-             * We allocate a maximum sized buffer here since we do not wish to
-             * waste time finding out how much space we actually need even if
-             * we could reliably do that on SMP guests.
+             * Read TMDs until end-of-packet or tdte poll fails (underflow),
+             * gathering each buffer straight into the frame buffer after
+             * the previous one. There is no need to walk the chain first to
+             * size the frame as the buffer is already of maximum size.
              */
             unsigned cb = 4096 - tmd.tmd1.bcnt;
-	    dev->xmit_pos = pcnetCalcPacketLen(dev, cb);
+	    dev->xmit_pos = cb;
 	    use_phys_exec = 1;
 	    dma_bm_read(PHYSADDR(dev, tmd.tmd0.tbadr), dev->abLoopBuf, cb, dev->transfer_size);
 	    use_phys_exec = 0;
@@ -0,0 +1,318 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Reflector network provider, for measuring the emulated cards.
+ *
+ *		Frames sent by the card are handed straight back to it with
+ *		the addresses swapped, and frames of a configured size can
+ *		be generated at a configured rate as well. Everything runs
+ *		on the emulation thread, so no host networking is involved
+ *		and the numbers only depend on the card and the network
+ *		core. Once per emulated second the frame and byte rates in
+ *		each direction and the latency from the card sending (or the
+ *		reflector generating) a frame to the card receiving it, in
+ *		both emulated and host time, are written to the log.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/timer.h>
+#include <86box/plat.h>
+#include <86box/network.h>
+
+
+#define REFLECT_TICK	1000.0		/* Generator period, in microseconds. */
+#define REFLECT_REPORT	1000		/* Ticks between reports. */
+#define REFLECT_DEPTH	32		/* Generated frames kept queued at full rate. */
+#define REFLECT_ETHTYPE	0x88b5		/* Local experimental EtherType. */
+
+
+typedef struct {
+    uint64_t	host, emu;
+} reflect_stamp_t;
+
+typedef struct {
+    uint32_t	frames;
+    uint64_t	bytes;
+} reflect_count_t;
+
+
+int		network_reflect_size = 0;	/* config */
+int		network_reflect_rate = 0;	/* config */
+
+static const netcard_t	*reflect_card = NULL;
+static uint8_t		reflect_guest[6];
+static const uint8_t	reflect_mac[6] = { 0x02, 0x52, 0x45, 0x46, 0x4c, 0x54 };
+static pc_timer_t	reflect_timer;
+static int		reflect_active = 0;
+
+/* Frames queued to the card, in the order it will receive them. */
+static reflect_stamp_t	reflect_stamps[NET_QUEUE_LEN];
+static int		reflect_head, reflect_tail;
+
+static uint8_t		reflect_buf[NET_PKT_SLOT];
+static uint32_t		reflect_seq;
+static double		reflect_credit;
+static int		reflect_ticks;
+static uint64_t		reflect_report_host;
+static reflect_count_t	reflect_tx, reflect_rx;
+static uint32_t		reflect_dropped;
+static double		reflect_lat_emu, reflect_lat_host,
+			reflect_max_emu, reflect_max_host;
+
+
+/* Emulated time in microseconds. */
+static uint64_t
+reflect_emu_time(void)
+{
+    if (TIMER_USEC == 0)
+	return 0;
+
+    return (uint64_t) (((double) tsc * 4294967296.0) / (double) TIMER_USEC);
+}
+
+
+/* Host time in microseconds. */
+static uint64_t
+reflect_host_time(void)
+{
+    return (uint64_t) (((double) plat_timer_read() * 1000000.0) / (double) timer_freq);
+}
+
+
+static int
+reflect_pending(void)
+{
+    return (reflect_head - reflect_tail) & (NET_QUEUE_LEN - 1);
+}
+
+
+/* Queue a frame for the card, remembering when it was sent. */
+static int
+reflect_queue(uint8_t *data, int len, uint64_t host, uint64_t emu)
+{
+    if (reflect_pending() == (NET_QUEUE_LEN - 1))
+	return -1;
+
+    if (network_queue_put(0, reflect_card->priv, data, len) < 0)
+	return -1;
+
+    reflect_stamps[reflect_head].host = host;
+    reflect_stamps[reflect_head].emu = emu;
+    reflect_head = (reflect_head + 1) & (NET_QUEUE_LEN - 1);
+
+    return 0;
+}
+
+
+static int
+reflect_generate(void)
+{
+    int len = network_reflect_size;
+
+    if (len < 60)
+	len = 60;
+    else if (len > 1514)
+	len = 1514;
+
+    memcpy(&reflect_buf[0], reflect_guest, 6);
+    memcpy(&reflect_buf[6], reflect_mac, 6);
+    reflect_buf[12] = REFLECT_ETHTYPE >> 8;
+    reflect_buf[13] = REFLECT_ETHTYPE & 0xff;
+    reflect_buf[14] = reflect_seq >> 24;
+    reflect_buf[15] = (reflect_seq >> 16) & 0xff;
+    reflect_buf[16] = (reflect_seq >> 8) & 0xff;
+    reflect_buf[17] = reflect_seq & 0xff;
+    memset(&reflect_buf[18], 0x00, len - 18);
+
+    if (reflect_queue(reflect_buf, len, reflect_host_time(), reflect_emu_time()) < 0) {
+	reflect_dropped++;
+	return -1;
+    }
+
+    reflect_seq++;
+    return 0;
+}
+
+
+static void
+reflect_report(void)
+{
+    uint64_t now = reflect_host_time();
+    double secs = (double) (now - reflect_report_host) / 1000000.0;
+
+    if (secs <= 0.0)
+	secs = 1.0;
+
+    pclog("Reflector: TX %u frames %.3f MB, RX %u frames %.3f MB per emulated second; "
+	  "%.2f emulated seconds per host second\n",
+	  reflect_tx.frames, (double) reflect_tx.bytes / 1048576.0,
+	  reflect_rx.frames, (double) reflect_rx.bytes / 1048576.0,
+	  1.0 / secs);
+
+    if (reflect_rx.frames) {
+	pclog("Reflector: latency avg %.1f us (max %.1f) emulated, "
+	      "avg %.1f us (max %.1f) host, %u dropped\n",
+	      reflect_lat_emu / reflect_rx.frames, reflect_max_emu,
+	      reflect_lat_host / reflect_rx.frames, reflect_max_host,
+	      reflect_dropped);
+    }
+
+    memset(&reflect_tx, 0x00, sizeof(reflect_count_t));
+    memset(&reflect_rx, 0x00, sizeof(reflect_count_t));
+    reflect_dropped = 0;
+    reflect_lat_emu = reflect_lat_host = 0.0;
+    reflect_max_emu = reflect_max_host = 0.0;
+    reflect_report_host = now;
+}
+
+
+static void
+reflect_tick(void *priv)
+{
+    int n;
+
+    if (network_reflect_size > 0) {
+	if (network_reflect_rate > 0) {
+		reflect_credit += (double) network_reflect_rate * (REFLECT_TICK / 1000000.0);
+		for (n = (int) reflect_credit; n > 0; n--) {
+			reflect_credit -= 1.0;
+			if (reflect_generate() < 0)
+				break;
+		}
+		/* Do not save up for a burst while the card is not keeping up. */
+		if (reflect_credit > 1.0)
+			reflect_credit = 1.0;
+	} else {
+		/* As fast as the card takes them. */
+		while (reflect_pending() < REFLECT_DEPTH) {
+			if (reflect_generate() < 0)
+				break;
+		}
+	}
+    }
+
+    if (++reflect_ticks == REFLECT_REPORT) {
+	reflect_report();
+	reflect_ticks = 0;
+    }
+
+    timer_on_auto(&reflect_timer, REFLECT_TICK);
+}
+
+
+/* Frame delivered to the card; called by the network core. */
+void
+net_reflect_rx_done(int len)
+{
+    reflect_stamp_t *st;
+    double emu, host;
+
+    if (!reflect_active || (reflect_pending() == 0))
+	return;
+
+    st = &reflect_stamps[reflect_tail];
+    reflect_tail = (reflect_tail + 1) & (NET_QUEUE_LEN - 1);
+
+    emu = (double) (reflect_emu_time() - st->emu);
+    host = (double) (reflect_host_time() - st->host);
+
+    reflect_lat_emu += emu;
+    reflect_lat_host += host;
+    if (emu > reflect_max_emu)
+	reflect_max_emu = emu;
+    if (host > reflect_max_host)
+	reflect_max_host = host;
+
+    reflect_rx.frames++;
+    reflect_rx.bytes += len;
+}
+
+
+/* Frame sent by the card; reflect it back. */
+void
+net_reflect_in(uint8_t *bufp, int len)
+{
+    if (!reflect_active || (len < 12) || (len > NET_PKT_SLOT))
+	return;
+
+    reflect_tx.frames++;
+    reflect_tx.bytes += len;
+
+    memcpy(reflect_buf, bufp, len);
+    memcpy(&reflect_buf[0], &bufp[6], 6);
+    if (bufp[0] & 0x01)
+	memcpy(&reflect_buf[6], reflect_mac, 6);
+    else
+	memcpy(&reflect_buf[6], &bufp[0], 6);
+
+    if (reflect_queue(reflect_buf, len, reflect_host_time(), reflect_emu_time()) < 0)
+	reflect_dropped++;
+}
+
+
+int
+net_reflect_init(void)
+{
+    return(0);
+}
+
+
+int
+net_reflect_reset(const netcard_t *card, uint8_t *mac)
+{
+    reflect_card = card;
+    memcpy(reflect_guest, mac, 6);
+
+    reflect_head = reflect_tail = 0;
+    reflect_seq = 0;
+    reflect_credit = 0.0;
+    reflect_ticks = 0;
+
+    memset(&reflect_tx, 0x00, sizeof(reflect_count_t));
+    memset(&reflect_rx, 0x00, sizeof(reflect_count_t));
+    reflect_dropped = 0;
+    reflect_lat_emu = reflect_lat_host = 0.0;
+    reflect_max_emu = reflect_max_host = 0.0;
+    reflect_report_host = reflect_host_time();
+
+    memset(&reflect_timer, 0x00, sizeof(pc_timer_t));
+    timer_add(&reflect_timer, reflect_tick, NULL, 0);
+    timer_on_auto(&reflect_timer, REFLECT_TICK);
+    reflect_active = 1;
+
+    if (network_reflect_size == 0)
+	pclog("Reflector: echoing frames\n");
+    else if (network_reflect_rate == 0)
+	pclog("Reflector: echoing frames, generating %d-byte frames at full rate\n",
+	      network_reflect_size);
+    else
+	pclog("Reflector: echoing frames, generating %d-byte frames at %d/s\n",
+	      network_reflect_size, network_reflect_rate);
+
+    return(0);
+}
+
+
+void
+net_reflect_close(void)
+{
+    if (!reflect_active)
+	return;
+
+    timer_stop(&reflect_timer);
+    memset(&reflect_timer, 0x00, sizeof(pc_timer_t));
+    reflect_active = 0;
+    reflect_card = NULL;
+}
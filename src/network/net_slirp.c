@@ -26,6 +26,18 @@
 #include <stdlib.h>
 #include <wchar.h>
 #include <slirp/libslirp.h>
+#ifndef _WIN32
+# define syscall host_syscall	/* Keep clear of the CPU's SYSCALL handler. */
+# include <unistd.h>
+# undef syscall
+# ifdef __linux__
+#  include <sys/eventfd.h>
+# else
+#  include <fcntl.h>
+#  include <sys/socket.h>
+#  define closesocket close
+# endif
+#endif
 #define HAVE_STDARG_H
 #include <86box/86box.h>
 #include <86box/device.h>
@@ -57,7 +69,8 @@ typedef struct {
     const netcard_t	*card; /* netcard attached to us */
     volatile thread_t	*poll_tid;
     event_t		*poll_state;
-    uint8_t		stop;
+    volatile uint8_t	stop;
+    int			wake_fd;
 #ifdef SLIRP_USE_POLL
     uint32_t		pfd_len, pfd_size;
     struct pollfd 	*pfd;
@@ -249,15 +262,118 @@ net_slirp_get_revents(int idx, void *opaque)
 }
 
 
+/* The polling thread is woken up for guest frames through an eventfd where
+   there is one, and through a loopback UDP socket sending to itself where
+   there is not, so it can wait in the same poll()/select() as SLiRP. */
+static void
+net_slirp_wake_open(slirp_t *slirp)
+{
+#ifdef __linux__
+    slirp->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+# ifdef _WIN32
+    u_long nb = 1;
+# endif
+    int fd;
+
+    slirp->wake_fd = -1;
+
+    fd = (int) socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+	return;
+
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	getsockname(fd, (struct sockaddr *) &addr, &len) ||
+	connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+	closesocket(fd);
+	return;
+    }
+
+# ifdef _WIN32
+    ioctlsocket(fd, FIONBIO, &nb);
+# else
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+# endif
+
+    slirp->wake_fd = fd;
+#endif
+
+    if (slirp->wake_fd < 0)
+	slirp_log("SLiRP: no wakeup descriptor, falling back to timed polling\n");
+}
+
+
+static void
+net_slirp_wake_close(int fd)
+{
+    if (fd < 0)
+	return;
+
+#ifdef __linux__
+    close(fd);
+#else
+    closesocket(fd);
+#endif
+}
+
+
+/* Swallow the pending wakeups. */
 static void
+net_slirp_wake_drain(slirp_t *slirp)
+{
+#ifdef __linux__
+    uint64_t val;
+
+    (void) !read(slirp->wake_fd, &val, sizeof(val));
+#else
+    char buf[16];
+
+    while (recv(slirp->wake_fd, buf, sizeof(buf), 0) > 0)
+	;
+#endif
+}
+
+
+/* Wake the polling thread up, called when the guest queues a frame. */
+void
+net_slirp_wake(void)
+{
+    slirp_t *s = slirp;
+
+    if ((s == NULL) || (s->wake_fd < 0))
+	return;
+
+#ifdef __linux__
+    uint64_t val = 1;
+
+    (void) !write(s->wake_fd, &val, sizeof(val));
+#else
+    send(s->wake_fd, "", 1, 0);
+#endif
+}
+
+
+/*
+ * Wait until one of SLiRP's sockets is ready, the guest has queued a
+ * frame, or SLiRP's next TCP timer is due, whichever comes first. The
+ * sockets are only collected here; processing them is left to the
+ * caller, with the network queue held.
+ */
+static int
 slirp_tic(slirp_t *slirp)
 {
-    int ret;
+    int ret, wake = -1;
     uint32_t tmo;
 
-    /* Let SLiRP create a list of all open sockets. */
-#ifdef SLIRP_USE_POLL
+    /* Let SLiRP create a list of all open sockets, and the timeout in
+       milliseconds until its timers next need servicing. */
     tmo = -1;
+#ifdef SLIRP_USE_POLL
     slirp->pfd_len = 0;
 #else
     slirp->nfds = -1;
@@ -267,22 +383,26 @@ slirp_tic(slirp_t *slirp)
 #endif
     slirp_pollfds_fill(slirp->slirp, &tmo, net_slirp_add_poll, slirp);
 
-    /* Now wait for something to happen, or at most 'tmo' usec. */
+    if (slirp->wake_fd >= 0)
+	wake = net_slirp_add_poll(slirp->wake_fd, SLIRP_POLL_IN, slirp);
+    else if (tmo > 10)
+	tmo = 10;
+
+    /* Now wait for something to happen, or at most 'tmo' msec. */
 #ifdef SLIRP_USE_POLL
     ret = poll(slirp->pfd, slirp->pfd_len, tmo);
 #else
-    if (tmo < 0)
-	tmo = 500;
-
     struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = tmo;
+    tv.tv_sec = tmo / 1000;
+    tv.tv_usec = (tmo % 1000) * 1000;
 
     ret = select(slirp->nfds + 1, &slirp->rfds, &slirp->wfds, &slirp->xfds, &tv);
 #endif
 
-    /* If something happened, let SLiRP handle it. */
-    slirp_pollfds_poll(slirp->slirp, (ret <= 0), net_slirp_get_revents, slirp);
+    if ((ret > 0) && (wake >= 0) && (net_slirp_get_revents(wake, slirp) & SLIRP_POLL_IN))
+	net_slirp_wake_drain(slirp);
+
+    return ret;
 }
 
 
@@ -304,8 +424,7 @@ static void
 poll_thread(void *arg)
 {
     slirp_t *slirp = (slirp_t *) arg;
-    event_t *evt;
-    int tx;
+    int ret;
 
     slirp_log("SLiRP: initializing...\n");
 
@@ -355,10 +474,10 @@ poll_thread(void *arg)
     slirp_log("SLiRP: polling started.\n");
     thread_set_event(slirp->poll_state);
 
-    /* Create a waitable event. */
-    evt = thread_create_event();
-
     while (!slirp->stop) {
+	/* Sleep until there is something to do. */
+	ret = slirp_tic(slirp);
+
 	/* Request ownership of the queue. */
 	network_wait(1);
 
@@ -368,27 +487,17 @@ poll_thread(void *arg)
 	/* Stop processing if asked to. */
 	if (slirp->stop) break;
 
-	/* See if there is any work. */
-	slirp_tic(slirp);
+	/* Let SLiRP handle whatever the sockets have for it. */
+	slirp_pollfds_poll(slirp->slirp, (ret <= 0), net_slirp_get_revents, slirp);
 
-	/* Wait for the next packet to arrive. */
-	tx = network_tx_queue_check();
-
-	if (tx)
+	/* Hand everything the guest has sent over to SLiRP. */
+	while (network_tx_queue_check())
 		network_do_tx();
 
-	/* If we did not get anything, wait a while. */
-	if (!tx)
-		thread_wait_event(evt, 10);
-
 	/* Release ownership of the queue. */
 	network_wait(0);
     }
 
-    /* No longer needed. */
-    if (evt)
-	thread_destroy_event(evt);
-
     slirp_log("SLiRP: polling stopped.\n");
     thread_set_event(slirp->poll_state);
 
@@ -418,6 +527,7 @@ net_slirp_reset(const netcard_t *card, uint8_t *mac)
     memset(new_slirp, 0, sizeof(slirp_t));
     new_slirp->mac = mac;
     new_slirp->card = card;
+    new_slirp->wake_fd = -1;
 #ifdef SLIRP_USE_POLL
     new_slirp->pfd_size = 16 * sizeof(struct pollfd);
     new_slirp->pfd = malloc(new_slirp->pfd_size);
@@ -432,6 +542,9 @@ net_slirp_reset(const netcard_t *card, uint8_t *mac)
     slirp->poll_tid = thread_create(poll_thread, new_slirp);
     thread_wait_event(slirp->poll_state, -1);
 
+    /* SLiRP has set up the socket layer by now. */
+    net_slirp_wake_open(new_slirp);
+
     return 0;
 }
 
@@ -439,6 +552,8 @@ net_slirp_reset(const netcard_t *card, uint8_t *mac)
 void
 net_slirp_close(void)
 {
+    int wake_fd;
+
     if (!slirp)
 	return;
 
@@ -448,8 +563,10 @@ net_slirp_close(void)
     slirp->stop = 1;
 
     /* Tell the thread to terminate. */
+    wake_fd = slirp->wake_fd;
     if (slirp->poll_tid) {
 	network_busy(0);
+	net_slirp_wake();
 
 	/* Wait for the thread to finish. */
 	slirp_log("SLiRP: waiting for thread to end...\n");
@@ -458,6 +575,8 @@ net_slirp_close(void)
 
     /* Shutdown work is done by the thread on its local copy of slirp. */
     slirp = NULL;
+
+    net_slirp_wake_close(wake_fd);
 }
 
 
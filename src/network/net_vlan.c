@@ -0,0 +1,439 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Local virtual LAN between emulator instances on one host.
+ *
+ *		Every instance that names the same VLAN maps the same shared
+ *		memory segment and claims a port in it. A port is a ring of
+ *		frame slots written only by its owner; every other instance
+ *		reads it with a cursor of its own, so the segment behaves as
+ *		a hub without any switch process, sockets or privileges. A
+ *		reader that falls a whole ring behind loses those frames, as
+ *		a real hub would under load.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <wchar.h>
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/device.h>
+#include <86box/plat.h>
+#include <86box/network.h>
+
+
+#define VLAN_MAGIC	0x4e414c56	/* 'VLAN' */
+#define VLAN_VERSION	1
+#define VLAN_PORTS	16		/* Instances per VLAN. */
+#define VLAN_SLOTS	256		/* Frames per port; a power of two. */
+#define VLAN_STALE	5		/* Seconds without a heartbeat before a port is free. */
+
+
+typedef struct {
+    uint32_t		seq;		/* Frame number + 1, 0 while being written. */
+    uint32_t		len;
+    uint8_t		data[NET_PKT_SLOT];
+} vlan_slot_t;
+
+typedef struct {
+    uint32_t		owner,		/* Process ID, 0 if free. */
+			head;		/* Frames written so far. */
+    int64_t		alive;		/* Heartbeat, in seconds. */
+    vlan_slot_t		slot[VLAN_SLOTS];
+} vlan_port_t;
+
+typedef struct {
+    uint32_t		magic,
+			version;
+    vlan_port_t		port[VLAN_PORTS];
+} vlan_shm_t;
+
+typedef struct {
+    vlan_shm_t		*shm;
+#ifdef _WIN32
+    HANDLE		map;
+#endif
+    int			self;
+    uint32_t		cursor[VLAN_PORTS],
+			lost;
+    const netcard_t	*card;
+    volatile thread_t	*poll_tid;
+    event_t		*poll_state;
+    volatile uint8_t	stop;
+    uint8_t		buf[NET_PKT_SLOT];
+} vlan_t;
+
+
+static vlan_t	*vlan;
+
+
+#ifdef ENABLE_VLAN_LOG
+int vlan_do_log = ENABLE_VLAN_LOG;
+
+
+static void
+vlan_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (vlan_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define vlan_log(fmt, ...)
+#endif
+
+
+static uint32_t
+vlan_pid(void)
+{
+#ifdef _WIN32
+    return (uint32_t) GetCurrentProcessId();
+#else
+    return (uint32_t) getpid();
+#endif
+}
+
+
+static vlan_shm_t *
+vlan_map(vlan_t *dev, const char *name)
+{
+    char path[128];
+    void *p;
+#ifndef _WIN32
+    struct stat st;
+    int fd;
+#endif
+
+#ifdef _WIN32
+    snprintf(path, sizeof(path), "Local\\86Box-VLAN-%s", name);
+    dev->map = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+				  0, sizeof(vlan_shm_t), path);
+    if (dev->map == NULL)
+	return NULL;
+
+    p = MapViewOfFile(dev->map, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(vlan_shm_t));
+    if (p == NULL) {
+	CloseHandle(dev->map);
+	dev->map = NULL;
+    }
+#else
+    snprintf(path, sizeof(path), "/86box-vlan-%s", name);
+    fd = shm_open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+	return NULL;
+
+    if ((fstat(fd, &st) < 0) ||
+	((st.st_size < (off_t) sizeof(vlan_shm_t)) && (ftruncate(fd, sizeof(vlan_shm_t)) < 0))) {
+	close(fd);
+	return NULL;
+    }
+
+    p = mmap(NULL, sizeof(vlan_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+	p = NULL;
+#endif
+
+    return (vlan_shm_t *) p;
+}
+
+
+static void
+vlan_unmap(vlan_t *dev)
+{
+    if (dev->shm == NULL)
+	return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(dev->shm);
+    CloseHandle(dev->map);
+    dev->map = NULL;
+#else
+    munmap(dev->shm, sizeof(vlan_shm_t));
+#endif
+    dev->shm = NULL;
+}
+
+
+/* Claim a free port, or one whose owner stopped updating its heartbeat. */
+static int
+vlan_claim(vlan_t *dev)
+{
+    vlan_port_t *port;
+    uint32_t owner, pid = vlan_pid();
+    int64_t now = (int64_t) time(NULL);
+    int i;
+
+    for (i = 0; i < VLAN_PORTS; i++) {
+	port = &dev->shm->port[i];
+	owner = __atomic_load_n(&port->owner, __ATOMIC_ACQUIRE);
+
+	if ((owner != 0) && ((now - __atomic_load_n(&port->alive, __ATOMIC_RELAXED)) < VLAN_STALE))
+		continue;
+
+	if (__atomic_compare_exchange_n(&port->owner, &owner, pid, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&port->alive, now, __ATOMIC_RELAXED);
+		return i;
+	}
+    }
+
+    return -1;
+}
+
+
+/* Pick up whatever the other ports have sent since we last looked. */
+static int
+vlan_receive(vlan_t *dev)
+{
+    vlan_port_t *port;
+    vlan_slot_t *slot;
+    uint32_t head, len;
+    int i, n = 0;
+
+    for (i = 0; i < VLAN_PORTS; i++) {
+	if (i == dev->self)
+		continue;
+
+	port = &dev->shm->port[i];
+	head = __atomic_load_n(&port->head, __ATOMIC_ACQUIRE);
+
+	if (__atomic_load_n(&port->owner, __ATOMIC_RELAXED) == 0) {
+		dev->cursor[i] = head;
+		continue;
+	}
+
+	if ((head - dev->cursor[i]) > VLAN_SLOTS) {
+		dev->lost += (head - dev->cursor[i]) - VLAN_SLOTS;
+		dev->cursor[i] = head - VLAN_SLOTS;
+	}
+
+	for (; dev->cursor[i] != head; dev->cursor[i]++) {
+		slot = &port->slot[dev->cursor[i] & (VLAN_SLOTS - 1)];
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (dev->cursor[i] + 1)) {
+			dev->lost++;
+			continue;
+		}
+
+		len = slot->len;
+		if (len > NET_PKT_SLOT)
+			len = NET_PKT_SLOT;
+		memcpy(dev->buf, slot->data, len);
+
+		/* The owner may have lapped us while we copied. */
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != (dev->cursor[i] + 1)) {
+			dev->lost++;
+			continue;
+		}
+
+		/* Leave the frame in the ring if the RX queue is full. */
+		if (network_queue_put(0, dev->card->priv, dev->buf, len) < 0)
+			return n;
+		n++;
+	}
+    }
+
+    return n;
+}
+
+
+static void
+poll_thread(void *arg)
+{
+    vlan_t *dev = (vlan_t *) arg;
+    const netcard_t *card = dev->card;
+    event_t *evt;
+    int rx, tx;
+
+    vlan_log("VLAN: polling started.\n");
+    thread_set_event(dev->poll_state);
+
+    /* Create a waitable event. */
+    evt = thread_create_event();
+
+    while (!dev->stop) {
+	/* Request ownership of the queue. */
+	network_wait(1);
+
+	/* Wait for a poll request. */
+	network_poll();
+
+	/* Stop processing if asked to. */
+	if (dev->stop) break;
+
+	__atomic_store_n(&dev->shm->port[dev->self].alive, (int64_t) time(NULL), __ATOMIC_RELAXED);
+
+	/* Leave frames in the ring while the card cannot take them. */
+	if (network_get_wait() || (card->set_link_state && card->set_link_state(card->priv)) ||
+	    (card->wait && card->wait(card->priv)))
+		rx = 0;
+	else
+		rx = vlan_receive(dev);
+
+	tx = network_tx_queue_check();
+	if (tx)
+		network_do_tx();
+
+	/* If we did not get anything, wait a while. */
+	if (!rx && !tx)
+		thread_wait_event(evt, 1);
+
+	/* Release ownership of the queue. */
+	network_wait(0);
+    }
+
+    /* No longer needed. */
+    if (evt)
+	thread_destroy_event(evt);
+
+    vlan_log("VLAN: polling stopped.\n");
+    thread_set_event(dev->poll_state);
+}
+
+
+/* Initialize the VLAN module for use. */
+int
+net_vlan_init(void)
+{
+    return 0;
+}
+
+
+/* Connect to the configured VLAN and start polling it. */
+int
+net_vlan_reset(const netcard_t *card, uint8_t *mac)
+{
+    vlan_t *dev;
+    uint32_t magic = 0;
+    int i;
+
+    dev = (vlan_t *) malloc(sizeof(vlan_t));
+    memset(dev, 0x00, sizeof(vlan_t));
+    dev->card = card;
+
+    dev->shm = vlan_map(dev, network_vlan);
+    if (dev->shm == NULL) {
+	pclog("VLAN: unable to map VLAN '%s'\n", network_vlan);
+	free(dev);
+	return -1;
+    }
+
+    /* Whoever gets here first stamps the segment. */
+    __atomic_compare_exchange_n(&dev->shm->magic, &magic, VLAN_MAGIC, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    if (dev->shm->version == 0)
+	dev->shm->version = VLAN_VERSION;
+    if ((dev->shm->magic != VLAN_MAGIC) || (dev->shm->version != VLAN_VERSION)) {
+	pclog("VLAN: '%s' is in use by an incompatible version\n", network_vlan);
+	vlan_unmap(dev);
+	free(dev);
+	return -1;
+    }
+
+    dev->self = vlan_claim(dev);
+    if (dev->self < 0) {
+	pclog("VLAN: all %d ports of '%s' are in use\n", VLAN_PORTS, network_vlan);
+	vlan_unmap(dev);
+	free(dev);
+	return -1;
+    }
+
+    /* Only frames sent from now on are of interest. */
+    for (i = 0; i < VLAN_PORTS; i++)
+	dev->cursor[i] = __atomic_load_n(&dev->shm->port[i].head, __ATOMIC_ACQUIRE);
+
+    pclog("VLAN: connected to '%s' on port %d\n", network_vlan, dev->self);
+
+    vlan = dev;
+
+    vlan_log("VLAN: creating thread...\n");
+    dev->poll_state = thread_create_event();
+    dev->poll_tid = thread_create(poll_thread, dev);
+    thread_wait_event(dev->poll_state, -1);
+
+    return 0;
+}
+
+
+void
+net_vlan_close(void)
+{
+    vlan_t *dev = vlan;
+
+    if (dev == NULL)
+	return;
+
+    vlan_log("VLAN: closing\n");
+
+    /* Tell the polling thread to shut down. */
+    dev->stop = 1;
+
+    if (dev->poll_tid) {
+	network_busy(0);
+
+	/* Wait for the thread to finish. */
+	vlan_log("VLAN: waiting for thread to end...\n");
+	thread_wait_event(dev->poll_state, -1);
+	vlan_log("VLAN: thread ended\n");
+	thread_destroy_event(dev->poll_state);
+    }
+
+    vlan_log("VLAN: %u frames lost\n", dev->lost);
+
+    /* Give the port back. */
+    __atomic_store_n(&dev->shm->port[dev->self].owner, 0, __ATOMIC_RELEASE);
+
+    vlan = NULL;
+    vlan_unmap(dev);
+    free(dev);
+}
+
+
+/* Send a frame to every other port; called from the polling thread. */
+void
+net_vlan_in(uint8_t *pkt, int pkt_len)
+{
+    vlan_port_t *port;
+    vlan_slot_t *slot;
+    uint32_t head;
+
+    if ((vlan == NULL) || (pkt_len <= 0) || (pkt_len > NET_PKT_SLOT))
+	return;
+
+    port = &vlan->shm->port[vlan->self];
+    head = port->head;
+    slot = &port->slot[head & (VLAN_SLOTS - 1)];
+
+    /* Mark the slot as being rewritten before touching its contents. */
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->len = pkt_len;
+    memcpy(slot->data, pkt, pkt_len);
+
+    __atomic_store_n(&slot->seq, head + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&port->head, head + 1, __ATOMIC_RELEASE);
+}
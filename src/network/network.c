@@ -54,13 +54,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <wchar.h>
-#include <sys/time.h>
 #define HAVE_STDARG_H
 #include <86box/86box.h>
 #include <86box/device.h>
 #include <86box/timer.h>
 #include <86box/plat.h>
 #include <86box/ui.h>
+#include <86box/ringbuf.h>
 #include <86box/network.h>
 #include <86box/net_3c503.h>
 #include <86box/net_ne2000.h>
@@ -118,6 +118,8 @@ int		network_card;
 char		network_host[522];
 netdev_t	network_devs[32];
 int		network_rx_pause = 0;
+int		network_speed = NET_SPEED_10M;
+char		network_vlan[64] = "default";
 #ifdef ENABLE_NIC_LOG
 int		nic_do_log = ENABLE_NIC_LOG;
 #endif
@@ -129,8 +131,20 @@ static mutex_t		*network_mutex;
 static uint8_t		*network_mac;
 static uint8_t		network_timer_active = 0;
 static pc_timer_t	network_rx_queue_timer;
-static netpkt_t		*first_pkt[2] = { NULL, NULL },
-			*last_pkt[2] = { NULL, NULL };
+
+#define NET_BYTE_TIME	(0.762939453125 * 2.0)	/* Microseconds per byte at 10 Mbit/s. */
+#define NET_RX_BATCH	16			/* Most frames delivered per tick. */
+
+/* Packet queues, 0 = RX and 1 = TX. Each is filled by exactly one thread
+   and drained by exactly one other, so the slots themselves serve as the
+   packet pool and no locking is needed. */
+static ringbuf_t	net_queue[2];
+static struct {
+    uint32_t		peak,		/* Deepest the queue has been. */
+			dropped,	/* Frames lost to a full queue. */
+			oversized,	/* Frames too large for a slot. */
+			alloc_failed;
+} net_queue_stats[2];
 
 
 static struct {
@@ -145,8 +159,6 @@ static struct {
 
 #ifdef ENABLE_NETWORK_LOG
 int network_do_log = ENABLE_NETWORK_LOG;
-static FILE *network_dump = NULL;
-static mutex_t *network_dump_mutex;
 
 
 static void
@@ -160,43 +172,8 @@ network_log(const char *fmt, ...)
 	va_end(ap);
     }
 }
-
-
-static void
-network_dump_packet(netpkt_t *pkt)
-{
-    if (!network_dump)
-	return;
-
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    struct {
-	uint32_t ts_sec, ts_usec, incl_len, orig_len;
-    } pcap_packet_hdr = {
-	tv.tv_sec, tv.tv_usec, pkt->len, pkt->len
-    };
-
-    if (network_dump_mutex)
-	thread_wait_mutex(network_dump_mutex);
-
-    size_t written;
-    if ((written = fwrite(&pcap_packet_hdr, 1, sizeof(pcap_packet_hdr), network_dump)) < sizeof(pcap_packet_hdr)) {
-	network_log("NETWORK: failed to write dump packet header\n");
-	fseek(network_dump, -written, SEEK_CUR);
-    } else {
-	if ((written = fwrite(pkt->data, 1, pkt->len, network_dump)) < pkt->len) {
-		network_log("NETWORK: failed to write dump packet data\n");
-		fseek(network_dump, -written - sizeof(pcap_packet_hdr), SEEK_CUR);
-	}
-	fflush(network_dump);
-    }
-
-    if (network_dump_mutex)
-	thread_release_mutex(network_dump_mutex);
-}
 #else
 #define network_log(fmt, ...)
-#define network_dump_packet(pkt)
 #endif
 
 
@@ -262,121 +239,140 @@ network_init(void)
     i = net_pcap_prepare(&network_devs[network_ndev]);
     if (i > 0)
 	network_ndev += i;
-
-#ifdef ENABLE_NETWORK_LOG
-    /* Start packet dump. */
-    network_dump = fopen("network.pcap", "wb");
-
-    struct {
-	uint32_t magic_number;
-	uint16_t version_major, version_minor;
-	int32_t	 thiszone;
-	uint32_t sigfigs, snaplen, network;
-    } pcap_hdr = {
-	0xa1b2c3d4,
-	2, 4,
-	0,
-	0, 65535, 1
-    };
-    fwrite(&pcap_hdr, sizeof(pcap_hdr), 1, network_dump);
-    fflush(network_dump);
-#endif
 }
 
 
-void
+int
 network_queue_put(int tx, void *priv, uint8_t *data, int len)
 {
-    netpkt_t *temp;
-
-    temp = (netpkt_t *) malloc(sizeof(netpkt_t));
-    memset(temp, 0, sizeof(netpkt_t));
-    temp->priv = priv;
-    memcpy(temp->data, data, len);
-    temp->len = len;
-    temp->prev = last_pkt[tx];
-    temp->next = NULL;
-
-    if (last_pkt[tx] != NULL)
-	last_pkt[tx]->next = temp;
-    last_pkt[tx] = temp;
-
-    if (first_pkt[tx] == NULL)
-	first_pkt[tx] = temp;
+    netpkt_t *pkt;
+    uint32_t used;
+
+    if (net_queue[tx].buf == NULL)
+	return(-1);
+
+    pkt = (netpkt_t *) ringbuf_write_ptr(&net_queue[tx]);
+    if (pkt == NULL) {
+	net_queue_stats[tx].dropped++;
+	return(-1);
+    }
+
+    if (len > NET_PKT_SLOT) {
+	net_queue_stats[tx].oversized++;
+	pkt->data = (uint8_t *) malloc(len);
+	if (pkt->data == NULL) {
+		net_queue_stats[tx].alloc_failed++;
+		return(-1);
+	}
+    } else
+	pkt->data = pkt->buf;
+
+    pkt->priv = priv;
+    memcpy(pkt->data, data, len);
+    pkt->len = len;
+
+    ringbuf_write_commit(&net_queue[tx]);
+
+    used = ringbuf_used(&net_queue[tx]);
+    if (used > net_queue_stats[tx].peak)
+	net_queue_stats[tx].peak = used;
+
+    return(0);
 }
 
 
 static void
 network_queue_get(int tx, netpkt_t **pkt)
 {
-    if (first_pkt[tx] == NULL)
-	*pkt = NULL;
-    else
-	*pkt = first_pkt[tx];
+    *pkt = (netpkt_t *) ringbuf_read_ptr(&net_queue[tx]);
 }
 
 
 static void
 network_queue_advance(int tx)
 {
-    netpkt_t *temp;
-
-    temp = first_pkt[tx];
+    netpkt_t *pkt;
 
-    if (temp == NULL)
+    pkt = (netpkt_t *) ringbuf_read_ptr(&net_queue[tx]);
+    if (pkt == NULL)
 	return;
 
-    first_pkt[tx] = temp->next;
-    free(temp);
+    if (pkt->data != pkt->buf)
+	free(pkt->data);
 
-    if (first_pkt[tx] == NULL)
-	last_pkt[tx] = NULL;
+    ringbuf_read_commit(&net_queue[tx]);
 }
 
 
 static void
 network_queue_clear(int tx)
 {
-    netpkt_t *temp = first_pkt[tx], *temp2;
-
-    if (temp == NULL)
+    if (net_queue[tx].buf == NULL)
 	return;
 
-    do {
-	temp2 = temp->next;
-	free(temp);
-	temp = temp2;
-    } while (temp != NULL);
+    while (ringbuf_used(&net_queue[tx]))
+	network_queue_advance(tx);
+
+    network_log("NETWORK: %s queue peak %u, dropped %u, oversized %u (%u failed)\n",
+		tx ? "TX" : "RX", net_queue_stats[tx].peak, net_queue_stats[tx].dropped,
+		net_queue_stats[tx].oversized, net_queue_stats[tx].alloc_failed);
 
-    first_pkt[tx] = last_pkt[tx] = NULL;
+    ringbuf_close(&net_queue[tx]);
 }
 
 
+/*
+ * Hand queued frames to the card.
+ *
+ * At least one frame goes in per tick, as before; if the card can tell
+ * us it has room for more, up to NET_RX_BATCH of them are delivered at
+ * once and the timer is re-armed for the time they took on the wire, so
+ * the average rate still follows the configured link speed.
+ */
 static void
 network_rx_queue(void *priv)
 {
+    netcard_t *card = &net_cards[network_card];
+    double byte_time = NET_BYTE_TIME;
+    netpkt_t *pkt = NULL;
+    int bytes = 0, n = 0;
+
+    if (network_speed != NET_SPEED_10M)
+	byte_time /= 10.0;
+
     if (network_rx_pause) {
-	timer_on_auto(&network_rx_queue_timer, 0.762939453125 * 2.0 * 128.0);
+	timer_on_auto(&network_rx_queue_timer, byte_time * 128.0);
 	return;
     }
 
-    netpkt_t *pkt = NULL;
+    while (n < NET_RX_BATCH) {
+	network_queue_get(0, &pkt);
+	if (pkt == NULL)
+		break;
 
-    network_busy(1);
+	/* Only queue up further frames if the card says it can take them. */
+	if (n && ((card->wait == NULL) || card->wait(card->priv)))
+		break;
 
-    network_queue_get(0, &pkt);
-    if ((pkt != NULL) && (pkt->len > 0)) {
-	network_dump_packet(pkt);
-	net_cards[network_card].rx(pkt->priv, pkt->data, pkt->len);
-	if (pkt->len >= 128)
-		timer_on_auto(&network_rx_queue_timer, 0.762939453125 * 2.0 * ((double) pkt->len));
-	else
-		timer_on_auto(&network_rx_queue_timer, 0.762939453125 * 2.0 * 128.0);
-    } else
-	timer_on_auto(&network_rx_queue_timer, 0.762939453125 * 2.0 * 128.0);
-    network_queue_advance(0);
+	if (pkt->len > 0) {
+		if (network_capture)
+			network_capture_packet(NET_CAPTURE_IN, pkt->data, pkt->len);
+		card->rx(pkt->priv, pkt->data, pkt->len);
+		if (network_type == NET_TYPE_REFLECT)
+			net_reflect_rx_done(pkt->len);
+		bytes += (pkt->len >= 128) ? pkt->len : 128;
+	}
+	network_queue_advance(0);
+	n++;
+
+	if (network_rx_pause)
+		break;
+    }
+
+    if ((bytes == 0) || (network_speed == NET_SPEED_MAX))
+	bytes = 128;
 
-    network_busy(0);
+    timer_on_auto(&network_rx_queue_timer, byte_time * ((double) bytes));
 }
 
 
@@ -405,6 +401,14 @@ network_attach(void *dev, uint8_t *mac, NETRXCB rx, NETWAITCB wait, NETSETLINKST
     poll_data.wake_poll_thread = thread_create_event();
     poll_data.poll_complete = thread_create_event();
 
+    /* Set up the packet queues before the platform module can use them. */
+    memset(net_queue_stats, 0x00, sizeof(net_queue_stats));
+    ringbuf_init(&net_queue[0], sizeof(netpkt_t), NET_QUEUE_LEN);
+    ringbuf_init(&net_queue[1], sizeof(netpkt_t), NET_QUEUE_LEN);
+
+    if (network_capture)
+	network_capture_start();
+
     /* Activate the platform module. */
     switch(network_type) {
 	case NET_TYPE_PCAP:
@@ -414,18 +418,43 @@ network_attach(void *dev, uint8_t *mac, NETRXCB rx, NETWAITCB wait, NETSETLINKST
 	case NET_TYPE_SLIRP:
 		(void)net_slirp_reset(&net_cards[network_card], network_mac);
 		break;
+
+	case NET_TYPE_VLAN:
+		(void)net_vlan_reset(&net_cards[network_card], network_mac);
+		break;
+
+	case NET_TYPE_REFLECT:
+		(void)net_reflect_reset(&net_cards[network_card], network_mac);
+		break;
     }
 
-    first_pkt[0] = first_pkt[1] = NULL;
-    last_pkt[0] = last_pkt[1] = NULL;
     memset(&network_rx_queue_timer, 0x00, sizeof(pc_timer_t));
     timer_add(&network_rx_queue_timer, network_rx_queue, NULL, 0);
-    /* 10 mbps. */
-    timer_on_auto(&network_rx_queue_timer, 0.762939453125 * 2.0);
+    timer_on_auto(&network_rx_queue_timer, NET_BYTE_TIME);
     network_timer_active = 1;
 }
 
 
+/*
+ * Turn capturing on or off while running. The caller must keep the
+ * emulation thread out of the way, as network_capture_start() requires.
+ */
+void
+network_capture_enable(int on)
+{
+    network_capture = !!on;
+
+    /* Not attached yet, network_attach() will see the new setting. */
+    if (! network_timer_active)
+	return;
+
+    if (network_capture)
+	network_capture_start();
+      else
+	network_capture_stop();
+}
+
+
 /* Stop the network timer. */
 void
 network_timer_stop(void)
@@ -452,7 +481,16 @@ network_close(void)
 
     /* Force-close the SLIRP module. */
     net_slirp_close();
- 
+
+    /* Force-close the VLAN module. */
+    net_vlan_close();
+
+    /* Force-close the reflector. */
+    net_reflect_close();
+
+    /* Finish the capture file, if any. */
+    network_capture_stop();
+
     /* Close the network events. */
     if (poll_data.wake_poll_thread != NULL) {
 	thread_destroy_event(poll_data.wake_poll_thread);
@@ -467,10 +505,6 @@ network_close(void)
     thread_close_mutex(network_mutex);
     network_mutex = NULL;
     network_mac = NULL;
-#ifdef ENABLE_NETWORK_LOG
-    thread_close_mutex(network_dump_mutex);
-    network_dump_mutex = NULL;
-#endif
 
     /* Here is where we clear the queues. */
     network_queue_clear(0);
@@ -510,9 +544,6 @@ network_reset(void)
     if ((network_type==NET_TYPE_NONE) || (network_card==0)) return;
 
     network_mutex = thread_create_mutex();
-#ifdef ENABLE_NETWORK_LOG
-    network_dump_mutex = thread_create_mutex();
-#endif
 
     /* Initialize the platform module. */
     switch(network_type) {
@@ -523,6 +554,14 @@ network_reset(void)
 	case NET_TYPE_SLIRP:
 		i = net_slirp_init();
 		break;
+
+	case NET_TYPE_VLAN:
+		i = net_vlan_init();
+		break;
+
+	case NET_TYPE_REFLECT:
+		i = net_reflect_init();
+		break;
     }
 
     if (i < 0) {
@@ -540,7 +579,8 @@ network_reset(void)
     }
 
     network_log("NETWORK: set up for %s, card='%s'\n",
-	(network_type==NET_TYPE_SLIRP)?"SLiRP":"Pcap",
+	(network_type==NET_TYPE_REFLECT)?"Reflector":
+	(network_type==NET_TYPE_VLAN)?"VLAN":((network_type==NET_TYPE_SLIRP)?"SLiRP":"Pcap"),
 			net_cards[network_card].name);
 
     /* Add the (new?) card to the I/O system. */
@@ -556,15 +596,22 @@ network_reset(void)
 void
 network_tx(uint8_t *bufp, int len)
 {
-    network_busy(1);
-
     ui_sb_update_icon(SB_NETWORK, 1);
 
-    network_queue_put(1, NULL, bufp, len);
+    if (network_capture)
+	network_capture_packet(NET_CAPTURE_OUT, bufp, len);
 
-    ui_sb_update_icon(SB_NETWORK, 0);
+    /* The reflector answers right away, on this thread. */
+    if (network_type == NET_TYPE_REFLECT)
+	net_reflect_in(bufp, len);
+    else
+	network_queue_put(1, NULL, bufp, len);
+
+    /* SLiRP sleeps until it is told there is work. */
+    if (network_type == NET_TYPE_SLIRP)
+	net_slirp_wake();
 
-    network_busy(0);
+    ui_sb_update_icon(SB_NETWORK, 0);
 }
 
 
@@ -576,7 +623,6 @@ network_do_tx(void)
 
     network_queue_get(1, &pkt);
     if ((pkt != NULL) && (pkt->len > 0)) {
-	network_dump_packet(pkt);
 	switch(network_type) {
 		case NET_TYPE_PCAP:
 			net_pcap_in(pkt->data, pkt->len);
@@ -585,6 +631,10 @@ network_do_tx(void)
 		case NET_TYPE_SLIRP:
 			net_slirp_in(pkt->data, pkt->len);
 			break;
+
+		case NET_TYPE_VLAN:
+			net_vlan_in(pkt->data, pkt->len);
+			break;
 	}
     }
     network_queue_advance(1);
@@ -594,7 +644,7 @@ network_do_tx(void)
 int
 network_tx_queue_check(void)
 {
-    if ((first_pkt[1] == NULL) && (last_pkt[1] == NULL))
+    if ((net_queue[1].buf == NULL) || (ringbuf_used(&net_queue[1]) == 0))
 	return 0;
 
     return 1;
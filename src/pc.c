@@ -138,6 +138,7 @@ int	sound_is_float = 1,			/* (C) sound uses FP values */
 uint32_t mem_size = 0;				/* (C) memory size */
 int	cpu_manufacturer = 0,			/* (C) cpu manufacturer */
 	cpu_use_dynarec = 0,			/* (C) cpu uses/needs Dyna */
+	cpu_idle_skip = 1,			/* (C) skip idle polling loops */
 	cpu = 3,				/* (C) cpu type */
 	fpu_type = 0;				/* (C) fpu type */
 int	time_sync = 0;				/* (C) enable time sync */
@@ -155,6 +156,7 @@ extern int
 	writelnum;
 
 int	fps, framecount;			/* emulator % */
+int	idle_pct;				/* guest halted % */
 
 extern int	CPUID;
 extern int	output;
@@ -711,6 +713,9 @@ pc_reset_hard_close(void)
 
     midi_close();
 
+    /* The CD audio threads use the drives' read-ahead rings. */
+    sound_cd_thread_end();
+
     cdrom_close();
 
     zip_close();
@@ -867,6 +872,8 @@ pc_close(thread_t *ptr)
     codegen_close();
 #endif
 
+    idle_loop_report();
+
     nvr_save();
 
     config_save();
@@ -901,8 +908,12 @@ pc_close(thread_t *ptr)
 
     network_close();
 
+    sound_thread_end();
+
     sound_cd_thread_end();
 
+    sound_capture_close();
+
     cdrom_close();
 
     zip_close();
@@ -989,8 +1000,8 @@ pc_thread(void *param)
 			mbstowcs(wcpu, machines[machine].cpu[cpu_manufacturer].cpus[cpu_effective].name,
 				 strlen(machines[machine].cpu[cpu_manufacturer].cpus[cpu_effective].name)+1);
 			swprintf(temp, sizeof_w(temp),
-				 L"%ls v%ls - %i%% - %ls - %ls - %ls",
-				 EMU_NAME_W,EMU_VERSION_W,fps,wmachine,wcpu,
+				 L"%ls v%ls - %i%% (%i%% idle) - %ls - %ls - %ls",
+				 EMU_NAME_W,EMU_VERSION_W,fps,idle_pct,wmachine,wcpu,
 				 (!mouse_capture) ? plat_get_string(IDS_2077)
 				  : (mouse_get_buttons() > 2) ? plat_get_string(IDS_2078) : plat_get_string(IDS_2079));
 
@@ -1011,6 +1022,10 @@ pc_thread(void *param)
 
 		end_time = plat_timer_read();
 		main_time += (end_time - start_time);
+	} else if (!dopause && (drawits < 0)) {
+		/* Ahead of real time, which is where a halted guest ends
+		   up; sleep until the next frame is due. */
+		plat_delay_ms((drawits < -9) ? 10 : (1 - drawits));
 	} else {
 		/* Just so we dont overload the host OS. */
 		plat_delay_ms(1);
@@ -1032,9 +1047,18 @@ pc_thread(void *param)
 void
 pc_onesec(void)
 {
+    uint64_t total = (uint64_t) framecount * (clockrate / 100);
+
     fps = framecount;
     framecount = 0;
 
+    /* Share of last second's emulated cycles the CPU spent in HLT. */
+    if (total > 0)
+	idle_pct = (cpu_idle_cycles >= total) ? 100 : (int) ((cpu_idle_cycles * 100) / total);
+    else
+	idle_pct = 0;
+    cpu_idle_cycles = 0;
+
     title_update = 1;
 }
 
@@ -1002,6 +1002,13 @@ scsi_cdrom_read_data(scsi_cdrom_t *dev, int msf, int type, int flags, int32_t *l
     dev->old_len = 0;
     *len = 0;
 
+    /* User data only, from Mode 1 sectors. */
+    if (!msf && (flags == 0x10) && ((type == 2) || (type == 8)) &&
+	cdrom_readsectors_cooked(dev->drv, dev->buffer, dev->sector_pos, dev->requested_blocks)) {
+	dev->old_len = *len = dev->requested_blocks * 2048;
+	return 1;
+    }
+
     for (i = 0; i < dev->requested_blocks; i++) {
 	ret = cdrom_readsector_raw(dev->drv, dev->buffer + data_pos,
 				   dev->sector_pos + i, msf, type, flags, &temp_len);
@@ -20,19 +20,34 @@
  *		Copyright 2016-2020 Bit.
  *		Copyright 2008-2020 DOSBox Team.
  */
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <wchar.h>
+#define HAVE_STDARG_H
 #include <86box/86box.h>
 #include <86box/device.h>
 #include <86box/plat.h>
 #include <86box/plat_midi.h>
+#include <86box/ringbuf.h>
 #include <86box/midi.h>
 #include <86box/midi_input.h>
 
 
+#define MIDI_QUEUE	512		/* Queued output events; a power of two. */
+#define MIDI_SYSEX_QUEUE	65536	/* Bytes of queued SysEx data; a power of two. */
+
+
+/* One queued output event; SysEx payloads travel in a separate byte ring. */
+typedef struct {
+    uint32_t	time,			/* plat_get_ticks() when queued */
+		len;			/* SysEx length, or 0 for a short message */
+    uint8_t	msg[4];
+} midi_event_t;
+
+
 int midi_device_current = 0;
 static int midi_device_last = 0;
 int midi_input_device_current = 0;
@@ -43,6 +58,23 @@ midi_t *midi = NULL, *midi_in = NULL;
 midi_in_handler_t *mih_first = NULL, *mih_last = NULL,
 		  *mih_cur = NULL;
 
+/* Output events are handed to the device on a thread of their own, so a
+   slow backend (a SysEx dump to a host port, say) does not hold up the
+   emulated CPU. The queue has a single consumer; producers, which are
+   the emulation thread and the MIDI input thru path, serialize on
+   midi_out_mutex. */
+static ringbuf_t	midi_out_ring, midi_sysex_ring;
+static thread_t		*midi_out_thread_h = NULL;
+static event_t		*midi_out_event = NULL;
+static mutex_t		*midi_out_mutex = NULL;
+static volatile int	midi_out_on = 0;
+static uint8_t		midi_out_sysex[SYSEX_SIZE];
+
+/* Dispatch statistics, reported every MIDI_STATS_EVENTS events. */
+#define MIDI_STATS_EVENTS	1024
+static uint32_t		midi_out_events, midi_out_depth_max,
+			midi_out_lat_sum, midi_out_lat_max;
+
 uint8_t MIDI_InSysexBuf[SYSEX_SIZE];
 
 uint8_t MIDI_evt_len[256] = {
@@ -95,6 +127,26 @@ static const MIDI_IN_DEVICE midi_in_devices[] =
     {"", "", NULL}
 };
 
+#ifdef ENABLE_MIDI_LOG
+int midi_do_log = ENABLE_MIDI_LOG;
+
+
+static void
+midi_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (midi_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define midi_log(fmt, ...)
+#endif
+
+
 int
 midi_device_available(int card)
 {
@@ -159,6 +211,138 @@ midi_device_init()
 }
 
 
+static void
+midi_out_play_msg(uint8_t *msg)
+{
+    if (midi->m_out_device->play_msg)
+	midi->m_out_device->play_msg(msg);
+}
+
+
+static void
+midi_out_play_sysex(uint8_t *sysex, unsigned int len)
+{
+    if ((midi->midi_sysex_start) && (len >= 4) && (len <= 9) &&
+	(sysex[1] == 0x41) && (sysex[3] == 0x16)) {
+	/* pclog("MIDI: Skipping invalid MT-32 SysEx MIDI message\n"); */
+	return;
+    }
+
+    if (midi->m_out_device->play_sysex)
+	midi->m_out_device->play_sysex(sysex, len);
+
+    if (midi->midi_sysex_start) {
+	if (sysex[5] == 0x7f)
+		midi->midi_sysex_delay = 290;	/* All parameters reset */
+	else if ((sysex[5] == 0x10) && (sysex[6] == 0x00) && (sysex[7] == 0x04))
+		midi->midi_sysex_delay = 145;	/* Viking Child */
+	else if ((sysex[5] == 0x10) && (sysex[6] == 0x00) && (sysex[7] == 0x01))
+		midi->midi_sysex_delay = 30;	/* Dark Sun 1 */
+	else
+		midi->midi_sysex_delay = (unsigned int) (((float) (len) * 1.25f) * 1000.0f / 3125.0f) + 2;
+
+	midi->midi_sysex_start = plat_get_ticks();
+    }
+}
+
+
+/* Give the synth time to digest the last SysEx before anything else goes
+   out; this sleeps the dispatch thread, not the emulation. */
+static void
+midi_out_sysex_wait(void)
+{
+    uint32_t passed_ticks;
+
+    if (midi->midi_sysex_start) {
+	passed_ticks = plat_get_ticks() - midi->midi_sysex_start;
+	if (passed_ticks < midi->midi_sysex_delay)
+		plat_delay_ms(midi->midi_sysex_delay - passed_ticks);
+    }
+}
+
+
+static void
+midi_out_stats(midi_event_t *ev, uint32_t depth)
+{
+    uint32_t lat = plat_get_ticks() - ev->time;
+
+    midi_out_lat_sum += lat;
+    if (lat > midi_out_lat_max)
+	midi_out_lat_max = lat;
+    if (depth > midi_out_depth_max)
+	midi_out_depth_max = depth;
+
+    if (++midi_out_events == MIDI_STATS_EVENTS) {
+	midi_log("MIDI: %u events, queue depth max %u, dispatch latency avg %u ms max %u ms\n",
+		 midi_out_events, midi_out_depth_max,
+		 midi_out_lat_sum / midi_out_events, midi_out_lat_max);
+	midi_out_events = midi_out_depth_max = 0;
+	midi_out_lat_sum = midi_out_lat_max = 0;
+    }
+}
+
+
+static void
+midi_out_thread(void *param)
+{
+    midi_event_t *ev;
+    uint32_t depth;
+    int on;
+
+    do {
+	thread_wait_event(midi_out_event, -1);
+	thread_reset_event(midi_out_event);
+
+	/* Read the flag first so whatever was queued before a stop still
+	   goes out. */
+	on = midi_out_on;
+
+	while ((ev = (midi_event_t *) ringbuf_read_ptr(&midi_out_ring)) != NULL) {
+		depth = ringbuf_used(&midi_out_ring);
+
+		midi_out_sysex_wait();
+
+		if (ev->len) {
+			ringbuf_read(&midi_sysex_ring, midi_out_sysex, ev->len);
+			midi_out_play_sysex(midi_out_sysex, ev->len);
+		} else
+			midi_out_play_msg(ev->msg);
+
+		midi_out_stats(ev, depth);
+		ringbuf_read_commit(&midi_out_ring);
+	}
+    } while (on);
+}
+
+
+/* Queue an event for the dispatch thread; waits if the queue is full. */
+static void
+midi_out_queue(uint8_t *msg, uint8_t *sysex, uint32_t len)
+{
+    midi_event_t *ev;
+
+    thread_wait_mutex(midi_out_mutex);
+
+    while (((ev = (midi_event_t *) ringbuf_write_ptr(&midi_out_ring)) == NULL) ||
+	   ((MIDI_SYSEX_QUEUE - ringbuf_used(&midi_sysex_ring)) < len)) {
+	thread_set_event(midi_out_event);
+	plat_delay_ms(1);
+    }
+
+    ev->time = plat_get_ticks();
+    ev->len = len;
+    if (len)
+	ringbuf_write(&midi_sysex_ring, sysex, len);
+    else
+	memcpy(ev->msg, msg, 4);
+    ringbuf_write_commit(&midi_out_ring);
+
+    thread_release_mutex(midi_out_mutex);
+
+    thread_set_event(midi_out_event);
+}
+
+
 void
 midi_init(midi_device_t* device)
 {
@@ -166,6 +350,17 @@ midi_init(midi_device_t* device)
     memset(midi, 0, sizeof(midi_t));
 
     midi->m_out_device = device;
+
+    ringbuf_init(&midi_out_ring, sizeof(midi_event_t), MIDI_QUEUE);
+    ringbuf_init(&midi_sysex_ring, 1, MIDI_SYSEX_QUEUE);
+
+    midi_out_events = midi_out_depth_max = 0;
+    midi_out_lat_sum = midi_out_lat_max = 0;
+
+    midi_out_on = 1;
+    midi_out_mutex = thread_create_mutex();
+    midi_out_event = thread_create_event();
+    midi_out_thread_h = thread_create(midi_out_thread, NULL);
 }
 
 void
@@ -181,6 +376,21 @@ midi_in_init(midi_device_t* device, midi_t **mididev)
 void
 midi_close(void)
 {
+    if (midi_out_thread_h) {
+	midi_out_on = 0;
+	thread_set_event(midi_out_event);
+	thread_wait(midi_out_thread_h, -1);
+	midi_out_thread_h = NULL;
+
+	thread_destroy_event(midi_out_event);
+	midi_out_event = NULL;
+	thread_close_mutex(midi_out_mutex);
+	midi_out_mutex = NULL;
+
+	ringbuf_close(&midi_out_ring);
+	ringbuf_close(&midi_sysex_ring);
+    }
+
     if (midi && midi->m_out_device) {
 	free(midi->m_out_device);
 	midi->m_out_device = NULL;
@@ -218,16 +428,16 @@ midi_poll(void)
 void
 play_msg(uint8_t *msg)
 {
-    if (midi->m_out_device->play_msg)
-	midi->m_out_device->play_msg(msg);
+    if (midi_out_thread_h)
+	midi_out_queue(msg, NULL, 0);
 }
 
 
 void
 play_sysex(uint8_t *sysex, unsigned int len)
 {
-    if (midi->m_out_device->play_sysex)
-	midi->m_out_device->play_sysex(sysex, len);
+    if (midi_out_thread_h)
+	midi_out_queue(NULL, sysex, len);
 }
 
 
@@ -321,20 +531,12 @@ midi_raw_out_thru_rt_byte(uint8_t val)
 void
 midi_raw_out_byte(uint8_t val)
 {
-    uint32_t passed_ticks;
-
     if (!midi || !midi->m_out_device)
 	return;
 
     if ((midi->m_out_device->write && midi->m_out_device->write(val)))
 	return;
 
-    if (midi->midi_sysex_start) {
-	passed_ticks = plat_get_ticks() - midi->midi_sysex_start;
-	if (passed_ticks < midi->midi_sysex_delay)
-		plat_delay_ms(midi->midi_sysex_delay - passed_ticks);
-    }
-
     /* Test for a realtime MIDI message */
     if (val >= 0xf8) {
 	midi->midi_rt_buf[0] = val;
@@ -351,26 +553,7 @@ midi_raw_out_byte(uint8_t val)
 	} else {
 		midi->midi_sysex_data[midi->midi_pos++] = 0xf7;
 
-		if ((midi->midi_sysex_start) && (midi->midi_pos >= 4) && (midi->midi_pos <= 9) &&
-		    (midi->midi_sysex_data[1] == 0x41) && (midi->midi_sysex_data[3] == 0x16)) {
-			/* pclog("MIDI: Skipping invalid MT-32 SysEx MIDI message\n"); */
-		} else {
-			play_sysex(midi->midi_sysex_data, midi->midi_pos);
-			if (midi->midi_sysex_start) {
-				if (midi-> midi_sysex_data[5] == 0x7f)
-					midi->midi_sysex_delay = 290;	/* All parameters reset */
-				else if ((midi->midi_sysex_data[5] == 0x10) && (midi->midi_sysex_data[6] == 0x00) &&
-					 (midi->midi_sysex_data[7] == 0x04))
-					midi->midi_sysex_delay = 145;	/* Viking Child */
-				else if ((midi->midi_sysex_data[5] == 0x10) && (midi->midi_sysex_data[6] == 0x00) &&
-					 (midi->midi_sysex_data[7] == 0x01))
-					midi->midi_sysex_delay = 30;	/* Dark Sun 1 */
-				else
-					midi->midi_sysex_delay = (unsigned int) (((float) (midi->midi_pos) * 1.25f) * 1000.0f / 3125.0f) + 2;
-
-				midi->midi_sysex_start = plat_get_ticks();
-			}
-		}
+		play_sysex(midi->midi_sysex_data, midi->midi_pos);
 	}
     }
 
@@ -336,6 +336,9 @@ void fluidsynth_close(void* p)
 {
         if (!p) return;
 
+        /* Stop MIDI dispatch before the synth goes away; this frees p. */
+        midi_close();
+
         fluidsynth_t* data = &fsdev;
 
 	data->on = 0;
@@ -1,8 +1,11 @@
+#include <inttypes.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 #include <wchar.h>
+#define HAVE_STDARG_H
 #include <mt32emu/c_interface/c_interface.h>
 #include <86box/86box.h>
 #include <86box/device.h>
@@ -16,6 +19,26 @@
 extern void givealbuffer_midi(void *buf, uint32_t size);
 extern void al_set_midi(int freq, int buf_size);
 
+
+#ifdef ENABLE_MT32_LOG
+int mt32_do_log = ENABLE_MT32_LOG;
+
+
+static void
+mt32_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (mt32_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define mt32_log(fmt, ...)
+#endif
+
 static const mt32emu_report_handler_i_v0 handler_v0 = {
         /** Returns the actual interface version ID */
         NULL, //mt32emu_report_handler_version (*getVersionID)(mt32emu_report_handler_i i);
@@ -86,10 +109,10 @@ static event_t *start_event = NULL;
 static int mt32_on = 0;
 
 #define RENDER_RATE 100
-#define BUFFER_SEGMENTS 10
 
 static uint32_t samplerate = 44100;
 static int buf_size = 0;
+static int buffer_segments = 10;        /* 10 ms segments per output buffer */
 static float* buffer = NULL;
 static int16_t* buffer_int16 = NULL;
 static int midi_pos = 0;
@@ -114,12 +137,38 @@ void mt32_poll()
         }
 }
 
+/* Time spent rendering the current output buffer, in timer_freq units, so
+   the buffer length can be sized for the host; a segment is late when it
+   took longer to render than it lasts. */
+static uint64_t render_time = 0, render_max = 0;
+static int render_late = 0;
+
+static void mt32_render_stats(uint64_t t)
+{
+        render_time += t;
+        if (t > render_max)
+                render_max = t;
+        if (t > (timer_freq / RENDER_RATE))
+                render_late++;
+}
+
+static void mt32_render_stats_flush(void)
+{
+        mt32_log("MT32: buffer rendered in %" PRIu64 " us (worst segment %" PRIu64 " us, %i of %i segments late)\n",
+                 (uint64_t) ((render_time * 1000000ULL) / timer_freq), (uint64_t) ((render_max * 1000000ULL) / timer_freq),
+                 render_late, buffer_segments);
+
+        render_time = render_max = 0;
+        render_late = 0;
+}
+
 static void mt32_thread(void *param)
 {
 	int buf_pos = 0;
-	int bsize = buf_size / BUFFER_SEGMENTS;
+	int bsize = buf_size / buffer_segments;
 	float *buf;
 	int16_t *buf16;
+	uint64_t start;
 
 	thread_set_event(start_event);
 
@@ -128,15 +177,19 @@ static void mt32_thread(void *param)
                 thread_wait_event(event, -1);
                 thread_reset_event(event);
 
+		start = plat_timer_read();
+
 		if (sound_is_float)
 		{
 			buf = (float *) ((uint8_t*)buffer + buf_pos);
 			memset(buf, 0, bsize);
 			mt32_stream(buf, bsize / (2 * sizeof(float)));
+			mt32_render_stats(plat_timer_read() - start);
 			buf_pos += bsize;
 			if (buf_pos >= buf_size)
 			{
 				givealbuffer_midi(buffer, buf_size / sizeof(float));
+				mt32_render_stats_flush();
 				buf_pos = 0;
 			}
 		}
@@ -145,10 +198,12 @@ static void mt32_thread(void *param)
 			buf16 = (int16_t *) ((uint8_t*)buffer_int16 + buf_pos);
 			memset(buf16, 0, bsize);
 			mt32_stream_int16(buf16, bsize / (2 * sizeof(int16_t)));
+			mt32_render_stats(plat_timer_read() - start);
 			buf_pos += bsize;
 			if (buf_pos >= buf_size)
 			{
 				givealbuffer_midi(buffer_int16, buf_size / sizeof(int16_t));
+				mt32_render_stats_flush();
 				buf_pos = 0;
 			}
 		}
@@ -183,16 +238,19 @@ void* mt32emu_init(wchar_t *control_rom, wchar_t *pcm_rom)
         if (!mt32_check("mt32emu_open_synth", mt32emu_open_synth(context), MT32EMU_RC_OK)) return 0;
 
         samplerate = mt32emu_get_actual_stereo_output_samplerate(context);
+        /* Output latency is a whole buffer, so trade it against how much
+           slack the host gets for segments that take too long to render. */
+        buffer_segments = device_get_config_int("buffer_length") / (1000 / RENDER_RATE);
         /* buf_size = samplerate/RENDER_RATE*2; */
 	if (sound_is_float)
 	{
-	        buf_size = (samplerate/RENDER_RATE)*2*BUFFER_SEGMENTS*sizeof(float);
+	        buf_size = (samplerate/RENDER_RATE)*2*buffer_segments*sizeof(float);
 	        buffer = malloc(buf_size);
 		buffer_int16 = NULL;
 	}
 	else
 	{
-	        buf_size = (samplerate/RENDER_RATE)*2*BUFFER_SEGMENTS*sizeof(int16_t);
+	        buf_size = (samplerate/RENDER_RATE)*2*buffer_segments*sizeof(int16_t);
 	        buffer = NULL;
 		buffer_int16 = malloc(buf_size);
 	}
@@ -241,6 +299,9 @@ void mt32_close(void* p)
 {
         if (!p) return;
 
+        /* Stop MIDI dispatch before the synth goes away; this frees p. */
+        midi_close();
+
 	mt32_on = 0;
 	thread_set_event(event);
 	thread_wait(thread_h, -1);
@@ -306,6 +367,31 @@ static const device_config_t mt32_config[] =
                 .type = CONFIG_BINARY,
                 .default_int = 1
         },
+        {
+                .name = "buffer_length",
+                .description = "Buffer length",
+                .type = CONFIG_SELECTION,
+                .selection =
+                {
+                        {
+                                .description = "20 ms",
+                                .value = 20
+                        },
+                        {
+                                .description = "50 ms",
+                                .value = 50
+                        },
+                        {
+                                .description = "100 ms",
+                                .value = 100
+                        },
+                        {
+                                .description = "200 ms",
+                                .value = 200
+                        }
+                },
+                .default_int = 100
+        },
         {
                 .type = -1
         }
@@ -45,9 +45,10 @@ void* midi_input_init(const device_t *info)
 
 void system_midi_close(void* p)
 {
-        plat_midi_close();
-
+        /* Stop the dispatch thread before the port goes away. */
         midi_close();
+
+        plat_midi_close();
 }
 
 void midi_input_close(void* p)
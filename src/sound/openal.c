@@ -277,5 +277,9 @@ givealbuffer_cd(void *buf)
 void
 givealbuffer_midi(void *buf, uint32_t size)
 {
+    if (sound_capture)
+	sound_capture_write(SOUND_CAPTURE_MIDI, sound_is_float ? SOUND_CAPTURE_FLOAT : SOUND_CAPTURE_INT16,
+			    buf, size >> 1, midi_freq);
+
     givealbuffer_common(buf, 2, size, midi_freq);
 }
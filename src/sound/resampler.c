@@ -0,0 +1,242 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Stereo sample rate converter for sound devices whose native
+ *		rate differs from the mixer's.
+ *
+ *		The lowest quality level is plain linear interpolation,
+ *		the same as the devices used to do by themselves; the
+ *		others run a polyphase windowed-sinc FIR whose length is the
+ *		quality/CPU trade-off.
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include <86box/86box.h>
+#include <86box/resampler.h>
+
+
+#define RSM_PHASES	256		/* Filter phases between two input frames. */
+
+
+struct resampler_t {
+    int		taps;			/* 0 for linear interpolation */
+
+    /* Time is kept exactly, in units of 1 / (in_rate * out_rate) reduced by
+       their common divisor, so the rates never drift apart. */
+    int32_t	ratio,			/* One input frame */
+		step,			/* One output frame */
+		cnt;
+
+    /* Linear interpolation. */
+    int32_t	old[2], cur[2];
+
+    /* FIR; each history holds the window twice so it is always contiguous. */
+    float	*coef,			/* RSM_PHASES + 1 rows of taps */
+		*hist[2];
+    int		hpos;
+};
+
+
+static double
+resampler_sinc(double x)
+{
+    if (fabs(x) < 1e-9)
+	return 1.0;
+
+    return sin(M_PI * x) / (M_PI * x);
+}
+
+
+static void
+resampler_calc_coef(resampler_t *rs, uint32_t in_rate, uint32_t out_rate)
+{
+    double cutoff, x, t, sum;
+    int p, k;
+    float *row;
+
+    /* Keep below the lower of the two Nyquist rates. */
+    cutoff = 0.95 * ((out_rate < in_rate) ? ((double) out_rate / (double) in_rate) : 1.0);
+
+    for (p = 0; p <= RSM_PHASES; p++) {
+	row = &rs->coef[p * rs->taps];
+	sum = 0.0;
+
+	for (k = 0; k < rs->taps; k++) {
+		/* Output sits between taps taps/2 - 1 and taps/2. */
+		x = (double) (k - (rs->taps / 2 - 1)) - ((double) p / RSM_PHASES);
+		t = (x + (rs->taps / 2)) / rs->taps;
+		row[k] = (float) (cutoff * resampler_sinc(cutoff * x) *
+				  (0.42 - 0.5 * cos(2.0 * M_PI * t) + 0.08 * cos(4.0 * M_PI * t)));
+		sum += row[k];
+	}
+
+	for (k = 0; k < rs->taps; k++)
+		row[k] = (float) (row[k] / sum);
+    }
+}
+
+
+resampler_t *
+resampler_init(uint32_t in_rate, uint32_t out_rate, int quality)
+{
+    resampler_t *rs;
+    uint32_t a, b, t;
+
+    rs = (resampler_t *) malloc(sizeof(resampler_t));
+    if (rs == NULL)
+	return NULL;
+    memset(rs, 0x00, sizeof(resampler_t));
+
+    a = in_rate;
+    b = out_rate;
+    while (b != 0) {
+	t = a % b;
+	a = b;
+	b = t;
+    }
+    rs->ratio = out_rate / a;
+    rs->step = in_rate / a;
+
+    switch (quality) {
+	case RESAMPLER_LINEAR:
+	default:
+		rs->taps = 0;
+		break;
+	case RESAMPLER_LOW:
+		rs->taps = 8;
+		break;
+	case RESAMPLER_MEDIUM:
+		rs->taps = 16;
+		break;
+	case RESAMPLER_HIGH:
+		rs->taps = 32;
+		break;
+    }
+
+    if (rs->taps) {
+	rs->coef = (float *) malloc((RSM_PHASES + 1) * rs->taps * sizeof(float));
+	rs->hist[0] = (float *) malloc(4 * rs->taps * sizeof(float));
+	if ((rs->coef == NULL) || (rs->hist[0] == NULL)) {
+		free(rs->coef);
+		free(rs->hist[0]);
+		free(rs);
+		return NULL;
+	}
+	memset(rs->hist[0], 0x00, 4 * rs->taps * sizeof(float));
+	rs->hist[1] = rs->hist[0] + (2 * rs->taps);
+
+	resampler_calc_coef(rs, in_rate, out_rate);
+    }
+
+    return rs;
+}
+
+
+void
+resampler_close(resampler_t *rs)
+{
+    if (rs->taps) {
+	free(rs->coef);
+	free(rs->hist[0]);
+    }
+
+    free(rs);
+}
+
+
+static inline void
+resampler_push(resampler_t *rs, int32_t *frame)
+{
+    if (++rs->hpos == rs->taps)
+	rs->hpos = 0;
+
+    rs->hist[0][rs->hpos] = rs->hist[0][rs->hpos + rs->taps] = (float) frame[0];
+    rs->hist[1][rs->hpos] = rs->hist[1][rs->hpos + rs->taps] = (float) frame[1];
+}
+
+
+static inline float
+resampler_dot(const float *x, const float *h, int taps)
+{
+    int k;
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+    float tmp[4];
+
+    for (k = 0; k < taps; k += 4)
+	acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&x[k]), _mm_loadu_ps(&h[k])));
+
+    _mm_storeu_ps(tmp, acc);
+    return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]);
+#elif defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    float32x2_t sum;
+
+    for (k = 0; k < taps; k += 4)
+	acc = vmlaq_f32(acc, vld1q_f32(&x[k]), vld1q_f32(&h[k]));
+
+    sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    float acc = 0.0f;
+
+    for (k = 0; k < taps; k++)
+	acc += x[k] * h[k];
+
+    return acc;
+#endif
+}
+
+
+void
+resampler_run(resampler_t *rs, int32_t *out, uint32_t num,
+	      void (*gen)(void *priv, int32_t *frame), void *priv)
+{
+    int32_t frame[2];
+    const float *h;
+    uint32_t i;
+
+    for (i = 0; i < num; i++) {
+	if (!rs->taps) {
+		while (rs->cnt >= rs->ratio) {
+			rs->old[0] = rs->cur[0];
+			rs->old[1] = rs->cur[1];
+			gen(priv, rs->cur);
+			rs->cnt -= rs->ratio;
+		}
+
+		out[0] = (int32_t) (((int64_t) rs->old[0] * (rs->ratio - rs->cnt) +
+				     (int64_t) rs->cur[0] * rs->cnt) / rs->ratio);
+		out[1] = (int32_t) (((int64_t) rs->old[1] * (rs->ratio - rs->cnt) +
+				     (int64_t) rs->cur[1] * rs->cnt) / rs->ratio);
+	} else {
+		while (rs->cnt >= rs->ratio) {
+			gen(priv, frame);
+			resampler_push(rs, frame);
+			rs->cnt -= rs->ratio;
+		}
+
+		h = &rs->coef[(((int64_t) rs->cnt * RSM_PHASES + (rs->ratio >> 1)) / rs->ratio) * rs->taps];
+		out[0] = (int32_t) resampler_dot(&rs->hist[0][rs->hpos + 1], h, rs->taps);
+		out[1] = (int32_t) resampler_dot(&rs->hist[1][rs->hpos + 1], h, rs->taps);
+	}
+
+	rs->cnt += rs->step;
+	out += 2;
+    }
+}
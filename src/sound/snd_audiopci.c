@@ -1264,12 +1264,10 @@ static void es1371_poll(void *p)
 static void es1371_get_buffer(int32_t *buffer, int len, void *p)
 {
 	es1371_t *es1371 = (es1371_t *)p;
-	int c;
 
         es1371_update(es1371);
 
-	for (c = 0; c < len * 2; c++)
-		buffer[c] += (es1371->buffer[c] / 2);
+	sound_mix_add_int16_half(buffer, es1371->buffer, len * 2);
 	
 	es1371->pos = 0;
 }
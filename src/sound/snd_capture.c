@@ -0,0 +1,325 @@
+/*
+ * 86Box	A hypervisor and IBM PC system emulator that specializes in
+ *		running old operating systems and software designed for IBM
+ *		PC systems and compatibles from 1981 through fairly recent
+ *		system designs based on the PCI bus.
+ *
+ *		This file is part of the 86Box distribution.
+ *
+ *		Recording of the sound output to WAV files.
+ *
+ *		Each tap (the final mix, CD audio and MIDI synth output) is
+ *		copied as-is into a ring of its own by whichever thread
+ *		produces it, each buffer behind a small header giving its
+ *		sample format and rate; a writer thread converts the samples
+ *		to 16-bit PCM and does all the file I/O, starting a new file
+ *		whenever the format or rate changes. A tap whose ring is full
+ *		drops the buffer and counts the lost frames rather than
+ *		holding up its producer.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <wchar.h>
+#define HAVE_STDARG_H
+#include <86box/86box.h>
+#include <86box/plat.h>
+#include <86box/ringbuf.h>
+#include <86box/sound.h>
+
+
+#define CAPTURE_RING	(1 << 20)	/* Bytes per tap; a power of two. */
+#define CAPTURE_CHUNK	4096		/* Frames converted per write. */
+
+
+typedef struct {
+    int32_t		fmt, rate;
+    uint32_t		bytes;		/* Sample data following the header. */
+} capture_chunk_t;
+
+typedef struct {
+    const wchar_t	*name;
+    ringbuf_t		ring;
+    uint32_t		dropped;	/* Frames lost to a full ring. */
+
+    /* Writer side. */
+    int			fmt, rate;	/* Of the chunk being written. */
+    uint32_t		chunk_left;	/* Bytes of it still in the ring. */
+    FILE		*f;
+    uint32_t		data_size;
+} capture_tap_t;
+
+
+int	sound_capture = 0;
+
+static capture_tap_t	capture_taps[SOUND_CAPTURE_MAX] = {
+    { L"mix" }, { L"cd" }, { L"midi" }
+};
+static thread_t		*capture_thread_h = NULL;
+static event_t		*capture_event = NULL;
+static volatile int	capture_on = 0;
+static int16_t		capture_pcm[CAPTURE_CHUNK * 2];
+static uint8_t		capture_raw[CAPTURE_CHUNK * 2 * sizeof(int32_t)];
+
+
+#ifdef ENABLE_SOUND_CAPTURE_LOG
+int sound_capture_do_log = ENABLE_SOUND_CAPTURE_LOG;
+
+
+static void
+sound_capture_log(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (sound_capture_do_log) {
+	va_start(ap, fmt);
+	pclog_ex(fmt, ap);
+	va_end(ap);
+    }
+}
+#else
+#define sound_capture_log(fmt, ...)
+#endif
+
+
+static int
+capture_sample_size(int fmt)
+{
+    return (fmt == SOUND_CAPTURE_INT16) ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+
+static void
+capture_put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+
+static void
+capture_write_header(capture_tap_t *tap)
+{
+    uint8_t hdr[44];
+
+    memcpy(&hdr[0], "RIFF", 4);
+    capture_put_le32(&hdr[4], 36 + tap->data_size);
+    memcpy(&hdr[8], "WAVEfmt ", 8);
+    capture_put_le32(&hdr[16], 16);
+    capture_put_le32(&hdr[20], 0x00020001);		/* PCM, 2 channels */
+    capture_put_le32(&hdr[24], tap->rate);
+    capture_put_le32(&hdr[28], tap->rate * 4);		/* Bytes per second */
+    capture_put_le32(&hdr[32], 0x00100004);		/* 4-byte frames, 16 bits */
+    memcpy(&hdr[36], "data", 4);
+    capture_put_le32(&hdr[40], tap->data_size);
+
+    fseek(tap->f, 0, SEEK_SET);
+    fwrite(hdr, 1, sizeof(hdr), tap->f);
+    fseek(tap->f, 0, SEEK_END);
+}
+
+
+static void
+capture_open(capture_tap_t *tap)
+{
+    wchar_t path[1024], fn[128];
+
+    plat_append_filename(path, usr_path, L"capture");
+    if (! plat_dir_check(path))
+	plat_dir_create(path);
+    plat_path_slash(path);
+
+    plat_tempfile(fn, (wchar_t *) tap->name, L".wav");
+    wcscat(path, fn);
+
+    tap->f = plat_fopen(path, L"wb");
+    if (tap->f == NULL) {
+	sound_capture_log("Sound capture: unable to create %ls\n", path);
+	return;
+    }
+
+    tap->data_size = 0;
+    capture_write_header(tap);
+}
+
+
+static void
+capture_finish(capture_tap_t *tap)
+{
+    if (tap->f == NULL)
+	return;
+
+    capture_write_header(tap);
+    fclose(tap->f);
+    tap->f = NULL;
+}
+
+
+/* Convert and write whatever the tap has queued; returns frames written. */
+static uint32_t
+capture_drain(capture_tap_t *tap)
+{
+    int32_t *s32 = (int32_t *) capture_raw;
+    float *sf = (float *) capture_raw;
+    int16_t *s16 = (int16_t *) capture_raw;
+    uint32_t frame_size, frames, avail, total = 0, c;
+    capture_chunk_t chunk;
+    int32_t v;
+
+    while (1) {
+	if (tap->chunk_left == 0) {
+		if (ringbuf_used(&tap->ring) < sizeof(capture_chunk_t))
+			break;
+		ringbuf_read(&tap->ring, &chunk, sizeof(capture_chunk_t));
+
+		/* A WAV file has one format, so a change starts a new one. */
+		if ((chunk.fmt != tap->fmt) || (chunk.rate != tap->rate))
+			capture_finish(tap);
+
+		tap->fmt = chunk.fmt;
+		tap->rate = chunk.rate;
+		tap->chunk_left = chunk.bytes;
+	}
+
+	frame_size = capture_sample_size(tap->fmt) * 2;
+
+	avail = ringbuf_used(&tap->ring);
+	if (avail > tap->chunk_left)
+		avail = tap->chunk_left;
+	frames = avail / frame_size;
+	if (frames == 0)
+		break;
+	if (frames > CAPTURE_CHUNK)
+		frames = CAPTURE_CHUNK;
+
+	ringbuf_read(&tap->ring, capture_raw, frames * frame_size);
+	tap->chunk_left -= frames * frame_size;
+
+	for (c = 0; c < (frames * 2); c++) {
+		switch (tap->fmt) {
+			case SOUND_CAPTURE_INT32:
+				v = s32[c];
+				break;
+			case SOUND_CAPTURE_FLOAT:
+				v = (int32_t) (sf[c] * 32768.0f);
+				break;
+			case SOUND_CAPTURE_INT16:
+			default:
+				v = s16[c];
+				break;
+		}
+		capture_pcm[c] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+	}
+
+	if (tap->f == NULL)
+		capture_open(tap);
+	if (tap->f != NULL) {
+		fwrite(capture_pcm, sizeof(int16_t), frames * 2, tap->f);
+		tap->data_size += frames * 4;
+	}
+
+	total += frames;
+    }
+
+    return total;
+}
+
+
+static void
+capture_thread(void *param)
+{
+    int c, on;
+
+    do {
+	thread_wait_event(capture_event, 100);
+	thread_reset_event(capture_event);
+
+	on = capture_on;
+
+	for (c = 0; c < SOUND_CAPTURE_MAX; c++)
+		capture_drain(&capture_taps[c]);
+    } while (on);
+}
+
+
+void
+sound_capture_write(int tap_id, int fmt, const void *buf, int frames, int rate)
+{
+    capture_tap_t *tap = &capture_taps[tap_id];
+    capture_chunk_t chunk;
+
+    if (!capture_on)
+	return;
+
+    chunk.fmt = fmt;
+    chunk.rate = rate;
+    chunk.bytes = frames * capture_sample_size(fmt) * 2;
+    if ((CAPTURE_RING - ringbuf_used(&tap->ring)) < (sizeof(capture_chunk_t) + chunk.bytes)) {
+	tap->dropped += frames;
+	thread_set_event(capture_event);
+	return;
+    }
+
+    ringbuf_write(&tap->ring, &chunk, sizeof(capture_chunk_t));
+    ringbuf_write(&tap->ring, buf, chunk.bytes);
+
+    if (ringbuf_used(&tap->ring) >= (CAPTURE_RING / 2))
+	thread_set_event(capture_event);
+}
+
+
+void
+sound_capture_init(void)
+{
+    int c;
+
+    if (!sound_capture || capture_on)
+	return;
+
+    for (c = 0; c < SOUND_CAPTURE_MAX; c++) {
+	capture_taps[c].fmt = capture_taps[c].rate = 0;
+	capture_taps[c].chunk_left = 0;
+	capture_taps[c].dropped = 0;
+	capture_taps[c].f = NULL;
+	if (! ringbuf_init(&capture_taps[c].ring, 1, CAPTURE_RING))
+		return;
+    }
+
+    capture_on = 1;
+    capture_event = thread_create_event();
+    capture_thread_h = thread_create(capture_thread, NULL);
+}
+
+
+void
+sound_capture_close(void)
+{
+    capture_tap_t *tap;
+    int c;
+
+    if (!capture_on)
+	return;
+
+    capture_on = 0;
+    thread_set_event(capture_event);
+    thread_wait(capture_thread_h, -1);
+    capture_thread_h = NULL;
+
+    thread_destroy_event(capture_event);
+    capture_event = NULL;
+
+    for (c = 0; c < SOUND_CAPTURE_MAX; c++) {
+	tap = &capture_taps[c];
+
+	capture_finish(tap);
+
+	if (tap->dropped)
+		sound_capture_log("Sound capture: %ls dropped %u frames\n", tap->name, tap->dropped);
+
+	ringbuf_close(&tap->ring);
+    }
+}
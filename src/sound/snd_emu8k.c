@@ -15,6 +15,7 @@
 #include <86box/rom.h>
 #include <86box/timer.h>
 #include <86box/sound.h>
+#include <86box/resampler.h>
 #include <86box/snd_emu8k.h>
 
 
@@ -24,9 +25,9 @@
 //#define FILTER_CONSTANT
 #endif
 
-#if !defined RESAMPLER_LINEAR && !defined RESAMPLER_CUBIC
-//#define RESAMPLER_LINEAR
-#define RESAMPLER_CUBIC
+#if !defined EMU8K_INTERP_LINEAR && !defined EMU8K_INTERP_CUBIC
+//#define EMU8K_INTERP_LINEAR
+#define EMU8K_INTERP_CUBIC
 #endif
 
 //#define EMU8K_DEBUG_REGISTERS
@@ -1721,6 +1722,18 @@ int32_t emu8k_vol_slide(emu8k_slide_t* slide, int32_t target)
         return slide->last;
 }
 
+static inline int emu8k_filter_active(emu8k_voice_t *emu_voice)
+{
+        return emu_voice->filterq_idx || emu_voice->cvcf_curr_filt_ctoff != 0xFFFF;
+}
+
+/* Silent now, and the volume slide has nowhere to go. */
+static inline int emu8k_voice_muted(emu8k_voice_t *emu_voice)
+{
+        return emu_voice->cvcf_curr_volume == 0 && emu_voice->vtft_vol_target == 0 &&
+               emu_voice->volumeslide.last == 0;
+}
+
 //int32_t old_pitch[32]={0};
 //int32_t old_cut[32]={0};
 //int32_t old_vol[32]={0};
@@ -1746,23 +1759,42 @@ void emu8k_update(emu8k_t *emu8k)
         {
                 emu_voice = &emu8k->voice[c];
                 buf = &emu8k->buffer[emu8k->pos*2];
-                
+
+                /* A parked voice (no envelope engine, no pitch, muted and
+                 * with the filter bypassed) would not change any state in
+                 * the loop below, so don't bother walking the block. */
+                if (!emu_voice->env_engine_on && emu8k_voice_muted(emu_voice) &&
+                    emu_voice->cpf_curr_pitch == 0 && emu_voice->ptrx_pit_target == 0 &&
+                    emu_voice->addr.addr < emu_voice->loop_end.addr &&
+                    !emu8k_filter_active(emu_voice) && emu_voice->vtft_filter_target == 0xFFFF)
+                        goto voice_done;
+
                 for (pos = emu8k->pos; pos < new_pos; pos++)
                 {
                         int32_t dat;
 
+                        /* With the filter bypassed nothing keeps state from the
+                         * sample, so skip the fetch when it would not be heard. */
+                        if (!emu8k_filter_active(emu_voice) &&
+                            (emu_voice->cvcf_curr_volume == 0 || !(emu8k->hwcf3 & 0x04) ||
+                             CCCA_DMA_ACTIVE(emu_voice->ccca)))
+                        {
+                                buf += 2;
+                                goto envelopes;
+                        }
+
                         /* Waveform oscillator */
-#ifdef RESAMPLER_LINEAR
+#ifdef EMU8K_INTERP_LINEAR
                         dat = EMU8K_READ_INTERP_LINEAR(emu8k, emu_voice->addr.int_address, 
                                                 emu_voice->addr.fract_address);
 
-#elif defined RESAMPLER_CUBIC
+#elif defined EMU8K_INTERP_CUBIC
                         dat = EMU8K_READ_INTERP_CUBIC(emu8k, emu_voice->addr.int_address, 
                                                 emu_voice->addr.fract_address);
 #endif
 
                         /* Filter section */
-                        if (emu_voice->filterq_idx || emu_voice->cvcf_curr_filt_ctoff != 0xFFFF )
+                        if (emu8k_filter_active(emu_voice))
                         {
                                 int cutoff = emu_voice->cvcf_curr_filt_ctoff >> 8;
                                 const int64_t coef0 = filt_coeffs[emu_voice->filterq_idx][cutoff][0];
@@ -1854,6 +1886,7 @@ void emu8k_update(emu8k_t *emu8k)
                                 }
                         }
 
+envelopes:
                         if ( emu_voice->env_engine_on)
                         {
                                 int32_t attenuation = emu_voice->initial_att;
@@ -2092,7 +2125,8 @@ I've recopilated these sentences to get an idea of how to loop
                         emu_voice->cvcf_curr_volume = emu8k_vol_slide(&emu_voice->volumeslide,emu_voice->vtft_vol_target);
                         emu_voice->cvcf_curr_filt_ctoff = emu_voice->vtft_filter_target;
                 }
-                
+
+voice_done:
                 /* Update EMU voice registers. */
                 emu_voice->ccca = (((uint32_t)emu_voice->ccca_qcontrol) << 24) | emu_voice->addr.int_address;
                 emu_voice->cpf_curr_frac_addr = emu_voice->addr.fract_address;
@@ -2131,6 +2165,58 @@ I've recopilated these sentences to get an idea of how to loop
         
         emu8k->pos = new_pos;
 }
+/* Feed the resampler the frames left over from the last block, then this one. */
+static void emu8k_resample_gen(void *priv, int32_t *frame)
+{
+        emu8k_t *emu8k = (emu8k_t *)priv;
+
+        if (emu8k->carry_pos < emu8k->carry_len)
+        {
+                emu8k->last[0] = emu8k->carry[emu8k->carry_pos*2];
+                emu8k->last[1] = emu8k->carry[emu8k->carry_pos*2 + 1];
+                emu8k->carry_pos++;
+        }
+        else if (emu8k->read_pos < emu8k->pos)
+        {
+                emu8k->last[0] = emu8k->buffer[emu8k->read_pos*2];
+                emu8k->last[1] = emu8k->buffer[emu8k->read_pos*2 + 1];
+                emu8k->read_pos++;
+        }
+        /* Otherwise the block came up short (the chip was just reset); hold the last frame. */
+
+        frame[0] = emu8k->last[0];
+        frame[1] = emu8k->last[1];
+}
+
+/* Convert the block generated so far to len frames at 48 kHz, into resampled. */
+void emu8k_resample(emu8k_t *emu8k, int len)
+{
+        int32_t left[EMU8K_CARRY * 2];
+        int n = 0;
+
+        emu8k->carry_pos = 0;
+        emu8k->read_pos = 0;
+        resampler_run(emu8k->rs, emu8k->resampled, len, emu8k_resample_gen, emu8k);
+
+        /* Keep whatever was not consumed, so the next block continues in phase. */
+        while ((emu8k->carry_pos < emu8k->carry_len) && (n < EMU8K_CARRY))
+        {
+                left[n*2] = emu8k->carry[emu8k->carry_pos*2];
+                left[n*2 + 1] = emu8k->carry[emu8k->carry_pos*2 + 1];
+                emu8k->carry_pos++;
+                n++;
+        }
+        while ((emu8k->read_pos < emu8k->pos) && (n < EMU8K_CARRY))
+        {
+                left[n*2] = emu8k->buffer[emu8k->read_pos*2];
+                left[n*2 + 1] = emu8k->buffer[emu8k->read_pos*2 + 1];
+                emu8k->read_pos++;
+                n++;
+        }
+        memcpy(emu8k->carry, left, n * 2 * sizeof(int32_t));
+        emu8k->carry_len = n;
+}
+
 /* onboard_ram in kilobytes */
 void emu8k_init(emu8k_t *emu8k, uint16_t emu_addr, int onboard_ram)
 {
@@ -2155,6 +2241,10 @@ void emu8k_init(emu8k_t *emu8k, uint16_t emu_addr, int onboard_ram)
                 emu8k->rom[0x7ffff] = 0;
         }
 
+        emu8k->rs = resampler_init(44100, 48000, sound_resample_quality);
+        if (emu8k->rs == NULL)
+                fatal("emu8k_init(): unable to allocate the resampler\n");
+
         emu8k->empty = malloc(2*BLOCK_SIZE_WORDS); 
         memset(emu8k->empty, 0, 2*BLOCK_SIZE_WORDS);
 
@@ -2384,5 +2474,6 @@ void emu8k_close(emu8k_t *emu8k)
 {
         free(emu8k->rom);
         free(emu8k->ram);
+        resampler_close(emu8k->rs);
 }
 
@@ -72,6 +72,7 @@ typedef struct gus_t
         uint8_t adcommand;
         int waveirqs[32],rampirqs[32];
         int voices;
+        uint32_t active;        /*Voices with the wave or the ramp running*/
         uint8_t dmactrl;
 
         int32_t out_l, out_r;
@@ -130,6 +131,25 @@ int gusfreqs[]=
 
 double vol16bit[4096];
 
+/*Restart the sample clock if it was parked while the GF1 had nothing
+  to play.*/
+static void gus_wake(gus_t *gus)
+{
+        if (gus->active && ((gus->reset & 3) == 3) && !timer_is_enabled(&gus->samp_timer))
+                timer_set_delay_u64(&gus->samp_timer, gus->samp_latch);
+}
+
+/*Track whether voice d has its wave or its ramp running.*/
+static void gus_update_active(gus_t *gus, int d)
+{
+        if (!(gus->ctrl[d] & 3) || !(gus->rctrl[d] & 3))
+                gus->active |= (1u << d);
+        else
+                gus->active &= ~(1u << d);
+
+        gus_wake(gus);
+}
+
 void pollgusirqs(gus_t *gus)
 {
         int c;
@@ -239,6 +259,7 @@ void writegus(uint16_t addr, uint8_t val, void *p)
                 {
                         case 0: /*Voice control*/
                         gus->ctrl[gus->voice]=val;
+                        gus_update_active(gus, gus->voice);
                         break;
                         case 1: /*Frequency control*/
                         gus->freq[gus->voice]=(gus->freq[gus->voice]&0xFF00)|val;
@@ -291,6 +312,7 @@ gus->curx[gus->voice]=(gus->curx[gus->voice]&0xF807F00)|((val<<7)<<8);
                 {
                         case 0: /*Voice control*/
                         gus->ctrl[gus->voice] = val & 0x7f;
+                        gus_update_active(gus, gus->voice);
 
                         old = gus->waveirqs[gus->voice];                        
                         gus->waveirqs[gus->voice] = ((val & 0xa0) == 0xa0) ? 1 : 0;                        
@@ -345,6 +367,7 @@ gus->curx[gus->voice]=(gus->curx[gus->voice]&0xFFF8000)|((val&0x7F)<<8);
                         case 0xD: /*Ramp control*/
                         old = gus->rampirqs[gus->voice];
                         gus->rctrl[gus->voice] = val & 0x7F;
+                        gus_update_active(gus, gus->voice);
                         gus->rampirqs[gus->voice] = ((val & 0xa0) == 0xa0) ? 1 : 0;                        
                         if (gus->rampirqs[gus->voice] != old)
                                 pollgusirqs(gus);
@@ -469,6 +492,7 @@ gus->curx[gus->voice]=(gus->curx[gus->voice]&0xFFF8000)|((val&0x7F)<<8);
                         
                         case 0x4c: /*Reset*/
                         gus->reset = val;
+                        gus_wake(gus);
                         break;
                 }
                 break;
@@ -918,18 +942,25 @@ void gus_poll_wave(void *p)
         int d;
         int16_t v;
         int32_t vl;
+        uint32_t voices;
         int update_irqs = 0;
         
         gus_update(gus);
         
-	timer_advance_u64(&gus->samp_timer, gus->samp_latch);
-        
         gus->out_l = gus->out_r = 0;
 
-        if ((gus->reset & 3) != 3)
+        /*Nothing will move until a voice is started or the GF1 is taken
+          out of reset, so let the timer lapse; gus_update_active() will
+          bring it back. The held output is silence from here on.*/
+        if (((gus->reset & 3) != 3) || !gus->active)
                 return;
-        for (d=0;d<32;d++)
+
+	timer_advance_u64(&gus->samp_timer, gus->samp_latch);
+
+        for (voices = gus->active; voices; voices &= (voices - 1))
         {
+                d = __builtin_ctz(voices);
+
                 if (!(gus->ctrl[d] & 3))
                 {
                         if (gus->ctrl[d] & 4)
@@ -1066,6 +1097,8 @@ void gus_poll_wave(void *p)
                                 }
                         }
                 }
+                if ((gus->ctrl[d] & 3) && (gus->rctrl[d] & 3))
+                        gus->active &= ~(1u << d);
         }
 
         if (update_irqs)
@@ -1075,7 +1108,6 @@ void gus_poll_wave(void *p)
 static void gus_get_buffer(int32_t *buffer, int len, void *p)
 {
         gus_t *gus = (gus_t *)p;
-        int c;
 
 #if defined(DEV_BRANCH) && defined(USE_GUSMAX)  
         if (gus->max_ctrl)
@@ -1083,14 +1115,11 @@ static void gus_get_buffer(int32_t *buffer, int len, void *p)
 #endif	
         gus_update(gus);
         
-        for (c = 0; c < len * 2; c++)
-        {
 #if defined(DEV_BRANCH) && defined(USE_GUSMAX)    
 	if (gus->max_ctrl)
-		buffer[c] += (int32_t)(gus->ad1848.buffer[c] / 2);
+		sound_mix_add_int16_half(buffer, gus->ad1848.buffer, len * 2);
 #endif	
-                buffer[c] += (int32_t)gus->buffer[c & 1][c >> 1];
-        }
+        sound_mix_add_int16_planar(buffer, gus->buffer[0], gus->buffer[1], len);
 
 #if defined(DEV_BRANCH) && defined(USE_GUSMAX)    
     if (gus->max_ctrl)
@@ -44,12 +44,12 @@
 #include <86box/86box.h>
 #include <86box/timer.h>
 #include <86box/sound.h>
+#include <86box/resampler.h>
 #include <86box/snd_opl_nuked.h>
 
 
 #define WRBUF_SIZE	1024
 #define WRBUF_DELAY	1
-#define RSM_FRAC	10
 
 
 // Channel types
@@ -90,6 +90,7 @@ typedef struct slot {
     uint8_t	eg_gen;
     uint8_t	eg_rate;
     uint8_t	eg_ksl;
+    uint16_t	eg_tlksl;	/* Total level plus key scale level, kept by env_update_ksl(). */
     uint8_t	*trem;
     uint8_t	reg_vib;
     uint8_t	reg_type;
@@ -158,11 +159,7 @@ typedef struct chip {
     uint8_t	rm_tc_bit3;
     uint8_t	rm_tc_bit5;
 
-    //OPL3L
-    int32_t	rateratio;
-    int32_t	samplecnt;
-    int32_t	oldsamples[2];
-    int32_t	samples[2];
+    resampler_t	*rs;
 
     uint64_t	wrbuf_samplecnt;
     uint32_t	wrbuf_cur;
@@ -458,6 +455,7 @@ env_update_ksl(slot_t *slot)
 	ksl = 0;
 
     slot->eg_ksl = (uint8_t)ksl;
+    slot->eg_tlksl = (slot->reg_tl << 2) + (slot->eg_ksl >> kslshift[slot->reg_ksl]);
 }
 
 
@@ -476,8 +474,17 @@ env_calc(slot_t *slot)
     uint8_t eg_off;
     uint8_t reset = 0;
 
-    slot->eg_out = slot->eg_rout + (slot->reg_tl << 2) +
-		   (slot->eg_ksl >> kslshift[slot->reg_ksl]) + *slot->trem;
+    slot->eg_out = slot->eg_rout + slot->eg_tlksl + *slot->trem;
+
+    /* A released slot whose envelope has run out stays that way until
+       it is keyed on again, so skip the rate calculation; most of the
+       36 slots are in this state most of the time. */
+    if (!slot->key && (slot->eg_gen == envelope_gen_num_release) &&
+	(slot->eg_rout == 0x1ff)) {
+	slot->pg_reset = 0;
+	return;
+    }
+
     if (slot->key && slot->eg_gen == envelope_gen_num_release) {
 	reset = 1;
 	reg_rate = slot->reg_ar;
@@ -1312,19 +1319,7 @@ nuked_generate_resampled(void *priv, int32_t *bufp)
 {
     nuked_t *dev = (nuked_t *)priv;
 
-    while (dev->samplecnt >= dev->rateratio) {
-	dev->oldsamples[0] = dev->samples[0];
-	dev->oldsamples[1] = dev->samples[1];
-	nuked_generate(dev, dev->samples);
-	dev->samplecnt -= dev->rateratio;
-    }
-
-    bufp[0] = (int32_t)((dev->oldsamples[0] * (dev->rateratio - dev->samplecnt)
-		     + dev->samples[0] * dev->samplecnt) / dev->rateratio);
-    bufp[1] = (int32_t)((dev->oldsamples[1] * (dev->rateratio - dev->samplecnt)
-		     + dev->samples[1] * dev->samplecnt) / dev->rateratio);
-
-    dev->samplecnt += 1 << RSM_FRAC;
+    resampler_run(dev->rs, bufp, 1, nuked_generate, dev);
 }
 
 
@@ -1332,12 +1327,8 @@ void
 nuked_generate_stream(void *priv, int32_t *sndptr, uint32_t num)
 {
     nuked_t *dev = (nuked_t *)priv;
-    uint32_t i;
 
-    for (i = 0; i < num; i++) {
-	nuked_generate_resampled(dev, sndptr);
-	sndptr += 2;
-    }
+    resampler_run(dev->rs, sndptr, num, nuked_generate, dev);
 }
 
 
@@ -1385,7 +1376,9 @@ nuked_init(uint32_t samplerate)
     }
 
     dev->noise = 1;
-    dev->rateratio = (samplerate << RSM_FRAC) / 49716;
+    dev->rs = resampler_init(49716, samplerate, sound_resample_quality);
+    if (dev->rs == NULL)
+	fatal("nuked_init(): unable to allocate the resampler\n");
     dev->tremoloshift = 4;
     dev->vibshift = 1;
 
@@ -1398,5 +1391,6 @@ nuked_close(void *priv)
 {
     nuked_t *dev = (nuked_t *)priv;
 
+    resampler_close(dev->rs);
     free(dev);
 }
@@ -4,9 +4,13 @@
 #include <stdlib.h>
 #include "resid-fp/sid.h"
 #include <86box/plat.h>
+#include <86box/resampler.h>
 #include <86box/snd_resid.h>
 
 
+extern "C" int sound_resample_quality;
+
+
 typedef struct psid_t
 {
         /* resid sid implementation */
@@ -22,7 +26,9 @@ void *sid_init(void)
 {
 //        psid_t *psid;
         int c;
-        sampling_method method=SAMPLE_INTERPOLATE;
+        /* reSID has its own converter from the chip clock; follow the
+           shared quality setting for the choice of method. */
+        sampling_method method=(sound_resample_quality >= RESAMPLER_MEDIUM) ? SAMPLE_RESAMPLE_INTERPOLATE : SAMPLE_INTERPOLATE;
         float cycles_per_sec = 14318180.0 / 16.0;
         
         psid = new psid_t;
@@ -238,7 +238,7 @@ sb_get_buffer_sb16_awe32(int32_t *buffer, int len, void *p)
     sb_t *sb = (sb_t *)p;
     sb_ct1745_mixer_t *mixer = &sb->mixer_sb16;
     int c, dsp_rec_pos = sb->dsp.record_pos_write;
-    int c_emu8k, c_record;
+    int c_record;
     int32_t in_l, in_r;
     double out_l = 0.0, out_r = 0.0;
     double bass_treble;
@@ -246,25 +246,24 @@ sb_get_buffer_sb16_awe32(int32_t *buffer, int len, void *p)
     if (sb->opl_enabled)
 	opl3_update(&sb->opl);
 
-    if (sb->dsp.sb_type > SB16)
+    if (sb->dsp.sb_type > SB16) {
 	emu8k_update(&sb->emu8k);
+	emu8k_resample(&sb->emu8k, len);
+    }
 
     sb_dsp_update(&sb->dsp);
 
     for (c = 0; c < len * 2; c += 2) {
 	out_l = 0.0, out_r = 0.0;
 
-	if (sb->dsp.sb_type > SB16)
-		c_emu8k = ((((c / 2) * 44100) / 48000) * 2);
-
 	if (sb->opl_enabled) {
 		out_l = ((double) sb->opl.buffer[c    ]) * mixer->fm_l * 0.7171630859375;
 		out_r = ((double) sb->opl.buffer[c + 1]) * mixer->fm_r * 0.7171630859375;
 	}
 
 	if (sb->dsp.sb_type > SB16) {
-		out_l += (((double) sb->emu8k.buffer[c_emu8k])     * mixer->fm_l);
-		out_r += (((double) sb->emu8k.buffer[c_emu8k + 1]) * mixer->fm_r);
+		out_l += (((double) sb->emu8k.resampled[c])     * mixer->fm_l);
+		out_r += (((double) sb->emu8k.resampled[c + 1]) * mixer->fm_r);
 	}
 
 	/* TODO: Multi-recording mic with agc/+20db, CD, and line in with channel inversion */
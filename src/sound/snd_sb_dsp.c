@@ -340,9 +340,31 @@ sb_add_data(sb_dsp_t *dsp, uint8_t v)
 }
 
 
+/* Output DMA the output timer has to fetch samples for. */
+static int
+sb_dsp_output_active(sb_dsp_t *dsp)
+{
+    return (dsp->sb_8_enable && !dsp->sb_8_pause && dsp->sb_8_output) ||
+	   (dsp->sb_16_enable && !dsp->sb_16_pause && dsp->sb_16_output);
+}
+
+
+/* Re-arm the output timer after it was let to lapse by pollsb(). */
+static void
+sb_dsp_resume_output(sb_dsp_t *dsp)
+{
+    if (sb_dsp_output_active(dsp) && !timer_is_enabled(&dsp->output_timer))
+	timer_set_delay_u64(&dsp->output_timer, dsp->sblatcho);
+}
+
+
 void
 sb_start_dma(sb_dsp_t *dsp, int dma8, int autoinit, uint8_t format, int len)
 {
+    /* A DAC pause in progress has the output timer parked at its end,
+       bring it back to sample rate. */
+    if (dsp->sb_pausetime > -1)
+	timer_disable(&dsp->output_timer);
     dsp->sb_pausetime = -1;
 
     if (dma8) {
@@ -612,9 +634,16 @@ sb_exec_command(sb_dsp_t *dsp)
 		}
 		break;
 	case 0x80:	/* Pause DAC */
-		dsp->sb_pausetime = dsp->sb_data[0] + (dsp->sb_data[1] << 8);
-		if (!timer_is_enabled(&dsp->output_timer))
-			timer_set_delay_u64(&dsp->output_timer, dsp->sblatcho);
+		/* Output DMA is held for the whole pause, so rather than count
+		   it down one sample at a time, schedule a single event for its
+		   last sample, keeping the phase of a running output timer. */
+		if (timer_is_enabled(&dsp->output_timer) && (dsp->sb_pausetime < 0)) {
+			dsp->sb_pausetime = dsp->sb_data[0] + (dsp->sb_data[1] << 8);
+			timer_advance_u64(&dsp->output_timer, dsp->sblatcho * dsp->sb_pausetime);
+		} else {
+			dsp->sb_pausetime = dsp->sb_data[0] + (dsp->sb_data[1] << 8);
+			timer_set_delay_u64(&dsp->output_timer, dsp->sblatcho * (dsp->sb_pausetime + 1));
+		}
 		break;
 	case 0x90:	/* High speed 8-bit autoinit DMA output */
 		if (dsp->sb_type >= SB2)
@@ -685,14 +714,17 @@ sb_exec_command(sb_dsp_t *dsp)
 		break;
 	case 0xD4:	/* Continue 8-bit DMA */
 		dsp->sb_8_pause = 0;
+		sb_dsp_resume_output(dsp);
 		break;
 	case 0xD5:	/* Pause 16-bit DMA */
 		if (dsp->sb_type >= SB16)
 			dsp->sb_16_pause = 1;
 		break;
 	case 0xD6:	/* Continue 16-bit DMA */
-		if (dsp->sb_type >= SB16)
+		if (dsp->sb_type >= SB16) {
 			dsp->sb_16_pause = 0;
+			sb_dsp_resume_output(dsp);
+		}
 		break;
 	case 0xD8:	/* Get speaker status */
 		sb_add_data(dsp, dsp->sb_speaker ? 0xff : 0);
@@ -1081,6 +1113,12 @@ pollsb(void *p)
     int tempi, ref;
     int data[2];
 
+    /* With output DMA paused there is nothing to fetch until it is
+       continued, so let the timer lapse; sb_dsp_resume_output() re-arms
+       it. The DAC holds its last sample meanwhile. */
+    if ((dsp->sb_pausetime < 0) && !sb_dsp_output_active(dsp))
+	return;
+
     timer_advance_u64(&dsp->output_timer, dsp->sblatcho);
     if (dsp->sb_8_enable && !dsp->sb_8_pause && dsp->sb_pausetime < 0 && dsp->sb_8_output) {
 	sb_dsp_update(dsp);
@@ -1321,13 +1359,12 @@ pollsb(void *p)
 	}
     }
     if (dsp->sb_pausetime > -1) {
-	dsp->sb_pausetime--;
-	if (dsp->sb_pausetime < 0) {
-		sb_irq(dsp, 1);
-		if (!dsp->sb_8_enable)
-			timer_disable(&dsp->output_timer);
-		sb_dsp_log("SB pause over\n");
-	}
+	/* The whole pause has elapsed by now, see command 0x80. */
+	dsp->sb_pausetime = -1;
+	sb_irq(dsp, 1);
+	if (!dsp->sb_8_enable)
+		timer_disable(&dsp->output_timer);
+	sb_dsp_log("SB pause over\n");
     }
 }
 
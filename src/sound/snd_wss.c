@@ -79,14 +79,11 @@ void wss_write(uint16_t addr, uint8_t val, void *p)
 static void wss_get_buffer(int32_t *buffer, int len, void *p)
 {
 	wss_t *wss = (wss_t *)p;
-        int c;
 
 	opl3_update(&wss->opl);
 	ad1848_update(&wss->ad1848);
-        for (c = 0; c < len * 2; c++) {
-		buffer[c] += wss->opl.buffer[c];
-		buffer[c] += (wss->ad1848.buffer[c] / 2);
-	}
+	sound_mix_add(buffer, wss->opl.buffer, len * 2);
+	sound_mix_add_int16_half(buffer, wss->ad1848.buffer, len * 2);
 
 	wss->opl.pos = 0;
 	wss->ad1848.pos = 0;
@@ -38,6 +38,12 @@
 #include <86box/snd_sb_dsp.h>
 #include <86box/snd_azt2316a.h>
 #include <86box/filters.h>
+#include <86box/ringbuf.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 
 typedef struct {
@@ -52,16 +58,28 @@ typedef struct {
 } sound_handler_t;
 
 
+#define SOUND_RING	4	/* Mixed periods queued for the audio thread. */
+
+
 int sound_card_current = 0;
 int sound_pos_global = 0;
 int sound_gain = 0;
+int sound_sync = 0;
+int sound_resample_quality = 0;
 
 
 static sound_handler_t sound_handlers[8];
 
+static thread_t *sound_thread_h;
+static event_t *sound_event;
+static volatile int soundon = 0;
+static ringbuf_t sound_ring;
+static int sound_dropped = 0;
 static thread_t *sound_cd_thread_h;
 static event_t *sound_cd_event;
 static event_t *sound_cd_start_event;
+static thread_t *sound_cd_read_thread_h;
+static event_t *sound_cd_read_event;
 static int32_t *outbuffer;
 static float *outbuffer_ex;
 static int16_t *outbuffer_ex_int16;
@@ -75,6 +93,8 @@ static int16_t cd_out_buffer_int16[CD_BUFLEN * 2];
 static unsigned int cd_vol_l, cd_vol_r;
 static int cd_buf_update = CD_BUFLEN / SOUNDBUFLEN;
 static volatile int cdaudioon = 0;
+static volatile int cd_busy = 0;
+static int cd_late = 0;
 static int cd_thread_enable = 0;
 
 static void (*filter_cd_audio)(int channel, double *buffer, void *p) = NULL;
@@ -211,12 +231,50 @@ sound_cd_clean_buffers(void)
 }
 
 
+/* Attenuation per the specification, as a 16.16 fixed point factor. */
+static int32_t
+sound_cd_volume(int vol)
+{
+    if (vol >= 255)
+	return 65536;
+    else if (vol > 0)
+	return (int32_t) (((48.0 + (20.0 * log(((double) vol) / 256.0))) / 48.0) * 65536.0);
+    else
+	return 0;
+}
+
+
+/* Keeps the CD audio read-ahead rings filled, so the CD audio thread
+   never has to wait on the image itself. */
+static void
+sound_cd_read_thread(void *param)
+{
+    int i;
+
+    while (cdaudioon) {
+	thread_wait_event(sound_cd_read_event, -1);
+	thread_reset_event(sound_cd_read_event);
+
+	if (!cdaudioon)
+		return;
+
+	for (i = 0; i < CDROM_NUM; i++) {
+		if ((cdrom[i].bus_type == CDROM_BUS_DISABLED) ||
+		    (cdrom[i].cd_status != CD_STATUS_PLAYING))
+			continue;
+		cdrom_audio_prefetch(&(cdrom[i]));
+	}
+    }
+}
+
+
 static void
 sound_cd_thread(void *param)
 {
     int c, r, i, channel_select[2];
-    double audio_vol_l, audio_vol_r;
-    double cd_buffer_temp[2] = {0.0, 0.0};
+    int32_t audio_vol_l, audio_vol_r;
+    int32_t cd_buffer_temp[2] = {0, 0};
+    double cd_buffer_filter[2];
 
     thread_set_event(sound_cd_start_event);
 
@@ -227,6 +285,8 @@ sound_cd_thread(void *param)
 	if (!cdaudioon)
 		return;
 
+	cd_busy = 1;
+
 	sound_cd_clean_buffers();
 
 	for (i = 0; i < CDROM_NUM; i++) {
@@ -238,28 +298,13 @@ sound_cd_thread(void *param)
 				continue;
 
 		if (cdrom[i].get_volume) {
-			audio_vol_l = (float) (cdrom[i].get_volume(cdrom[i].priv, 0));
-			audio_vol_r = (float) (cdrom[i].get_volume(cdrom[i].priv, 1));
+			audio_vol_l = sound_cd_volume(cdrom[i].get_volume(cdrom[i].priv, 0));
+			audio_vol_r = sound_cd_volume(cdrom[i].get_volume(cdrom[i].priv, 1));
 		} else {
-			audio_vol_l = 255.0;
-			audio_vol_r = 255.0;
+			audio_vol_l = 65536;
+			audio_vol_r = 65536;
 		}
 
-		/* Calculate attenuation per the specification. */
-		if (audio_vol_l >= 255.0)
-			audio_vol_l = 1.0;
-		else if (audio_vol_l > 0.0)
-			audio_vol_l = (48.0 + (20.0 * log(audio_vol_l / 256.0))) / 48.0;
-		else
-			audio_vol_l = 0.0;
-
-		if (audio_vol_r >= 255.0)
-			audio_vol_r = 1.0;
-		else if (audio_vol_r > 0.0)
-			audio_vol_r = (48.0 + (20.0 * log(audio_vol_r / 256.0))) / 48.0;
-		else
-			audio_vol_r = 0.0;
-
 		if (cdrom[i].get_channel) {
 			channel_select[0] = cdrom[i].get_channel(cdrom[i].priv, 0);
 			channel_select[1] = cdrom[i].get_channel(cdrom[i].priv, 1);
@@ -270,35 +315,57 @@ sound_cd_thread(void *param)
 
 		for (c = 0; c < CD_BUFLEN*2; c += 2) {
 			/*Apply ATAPI channel select*/
-			cd_buffer_temp[0] = cd_buffer_temp[1] = 0.0;
+			cd_buffer_temp[0] = cd_buffer_temp[1] = 0;
 
-			if ((audio_vol_l != 0.0) && (channel_select[0] != 0)) {
+			if ((audio_vol_l != 0) && (channel_select[0] != 0)) {
 				if (channel_select[0] & 1)
-					cd_buffer_temp[0] += ((double) cd_buffer[i][c]);	/* Channel 0 => Port 0 */
+					cd_buffer_temp[0] += cd_buffer[i][c];		/* Channel 0 => Port 0 */
 				if (channel_select[0] & 2)
-					cd_buffer_temp[0] += ((double) cd_buffer[i][c + 1]);	/* Channel 1 => Port 0 */
+					cd_buffer_temp[0] += cd_buffer[i][c + 1];	/* Channel 1 => Port 0 */
 
-				cd_buffer_temp[0] *= audio_vol_l;				/* Multiply Port 0 by Port 0 volume */
+				/* Multiply Port 0 by Port 0 volume */
+				cd_buffer_temp[0] = (int32_t) (((int64_t) cd_buffer_temp[0] * audio_vol_l) >> 16);
 			}
 
-			if ((audio_vol_r != 0.0) && (channel_select[1] != 0)) {
+			if ((audio_vol_r != 0) && (channel_select[1] != 0)) {
 				if (channel_select[1] & 1)
-					cd_buffer_temp[1] += ((double) cd_buffer[i][c]);	/* Channel 0 => Port 1 */
+					cd_buffer_temp[1] += cd_buffer[i][c];		/* Channel 0 => Port 1 */
 				if (channel_select[1] & 2)
-					cd_buffer_temp[1] += ((double) cd_buffer[i][c + 1]);	/* Channel 1 => Port 1 */
+					cd_buffer_temp[1] += cd_buffer[i][c + 1];	/* Channel 1 => Port 1 */
 
-				cd_buffer_temp[1] *= audio_vol_r;				/* Multiply Port 1 by Port 1 volume */
+				/* Multiply Port 1 by Port 1 volume */
+				cd_buffer_temp[1] = (int32_t) (((int64_t) cd_buffer_temp[1] * audio_vol_r) >> 16);
 			}
 
 			/* Apply sound card CD volume and filters */
 			if (filter_cd_audio != NULL) {
-				filter_cd_audio(0, &(cd_buffer_temp[0]), filter_cd_audio_p);
-				filter_cd_audio(1, &(cd_buffer_temp[1]), filter_cd_audio_p);
+				cd_buffer_filter[0] = (double) cd_buffer_temp[0];
+				cd_buffer_filter[1] = (double) cd_buffer_temp[1];
+				filter_cd_audio(0, &(cd_buffer_filter[0]), filter_cd_audio_p);
+				filter_cd_audio(1, &(cd_buffer_filter[1]), filter_cd_audio_p);
+
+				if (sound_is_float) {
+					cd_out_buffer[c] += (float) (cd_buffer_filter[0] / 32768.0);
+					cd_out_buffer[c+1] += (float) (cd_buffer_filter[1] / 32768.0);
+					continue;
+				}
+
+				if (cd_buffer_filter[0] > 32767.0)
+					cd_buffer_filter[0] = 32767.0;
+				if (cd_buffer_filter[0] < -32768.0)
+					cd_buffer_filter[0] = -32768.0;
+				if (cd_buffer_filter[1] > 32767.0)
+					cd_buffer_filter[1] = 32767.0;
+				if (cd_buffer_filter[1] < -32768.0)
+					cd_buffer_filter[1] = -32768.0;
+
+				cd_buffer_temp[0] = (int32_t) cd_buffer_filter[0];
+				cd_buffer_temp[1] = (int32_t) cd_buffer_filter[1];
 			}
 
 			if (sound_is_float) {
-				cd_out_buffer[c] += (float) (cd_buffer_temp[0] / 32768.0);
-				cd_out_buffer[c+1] += (float) (cd_buffer_temp[1] / 32768.0);
+				cd_out_buffer[c] += ((float) cd_buffer_temp[0]) * (1.0f / 32768.0f);
+				cd_out_buffer[c+1] += ((float) cd_buffer_temp[1]) * (1.0f / 32768.0f);
 			} else {
 				if (cd_buffer_temp[0] > 32767)
 					cd_buffer_temp[0] = 32767;
@@ -315,10 +382,20 @@ sound_cd_thread(void *param)
 		}
 	}
 
-	if (sound_is_float)
+	/* Have the reader top up the rings for the next period. */
+	thread_set_event(sound_cd_read_event);
+
+	if (sound_is_float) {
+		if (sound_capture)
+			sound_capture_write(SOUND_CAPTURE_CD, SOUND_CAPTURE_FLOAT, cd_out_buffer, CD_BUFLEN, CD_FREQ);
 		givealbuffer_cd(cd_out_buffer);
-	else
+	} else {
+		if (sound_capture)
+			sound_capture_write(SOUND_CAPTURE_CD, SOUND_CAPTURE_INT16, cd_out_buffer_int16, CD_BUFLEN, CD_FREQ);
 		givealbuffer_cd(cd_out_buffer_int16);
+	}
+
+	cd_busy = 0;
     }
 }
 
@@ -367,10 +444,15 @@ sound_init(void)
 	thread_wait_event(sound_cd_start_event, -1);
 	thread_reset_event(sound_cd_start_event);
 	sound_log("Done!\n");
+
+	sound_cd_read_event = thread_create_event();
+	sound_cd_read_thread_h = thread_create(sound_cd_read_thread, NULL);
     } else
 	cdaudioon = 0;
 
     cd_thread_enable = available_cdrom_drives ? 1 : 0;
+
+    sound_capture_init();
 }
 
 
@@ -393,44 +475,281 @@ sound_set_cd_audio_filter(void (*filter)(int channel, double *buffer, void *p),
 }
 
 
+/* Mixing helpers, also used by the devices' get_buffer handlers. Each
+   has an SSE2 or NEON body for the bulk of the buffer and a scalar tail,
+   and gives exactly the same results as the plain C loops. */
+
+/* dst[i] += src[i] */
+void
+sound_mix_add(int32_t *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+#if defined(__SSE2__)
+    for (; c <= (len - 4); c += 4)
+	_mm_storeu_si128((__m128i *) &dst[c], _mm_add_epi32(_mm_loadu_si128((__m128i *) &dst[c]),
+							    _mm_loadu_si128((__m128i *) &src[c])));
+#elif defined(__ARM_NEON)
+    for (; c <= (len - 4); c += 4)
+	vst1q_s32(&dst[c], vaddq_s32(vld1q_s32(&dst[c]), vld1q_s32(&src[c])));
+#endif
+
+    for (; c < len; c++)
+	dst[c] += src[c];
+}
+
+
+#if defined(__SSE2__)
+/* Sign-extended x / 2, rounded towards zero like C division. */
+static inline __m128i
+sound_mix_half_sse2(__m128i x)
+{
+    return _mm_srai_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 31)), 1);
+}
+#elif defined(__ARM_NEON)
+static inline int32x4_t
+sound_mix_half_neon(int32x4_t x)
+{
+    return vshrq_n_s32(vaddq_s32(x, vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(x), 31))), 1);
+}
+#endif
+
+
+/* dst[i] += src[i] / 2, for the 16-bit codec buffers. */
+void
+sound_mix_add_int16_half(int32_t *dst, const int16_t *src, int len)
+{
+    int c = 0;
+#if defined(__SSE2__)
+    __m128i v, lo, hi;
+
+    for (; c <= (len - 8); c += 8) {
+	v = _mm_loadu_si128((__m128i *) &src[c]);
+	lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+	hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+	_mm_storeu_si128((__m128i *) &dst[c], _mm_add_epi32(_mm_loadu_si128((__m128i *) &dst[c]), sound_mix_half_sse2(lo)));
+	_mm_storeu_si128((__m128i *) &dst[c + 4], _mm_add_epi32(_mm_loadu_si128((__m128i *) &dst[c + 4]), sound_mix_half_sse2(hi)));
+    }
+#elif defined(__ARM_NEON)
+    int16x8_t v;
+
+    for (; c <= (len - 8); c += 8) {
+	v = vld1q_s16(&src[c]);
+	vst1q_s32(&dst[c], vaddq_s32(vld1q_s32(&dst[c]), sound_mix_half_neon(vmovl_s16(vget_low_s16(v)))));
+	vst1q_s32(&dst[c + 4], vaddq_s32(vld1q_s32(&dst[c + 4]), sound_mix_half_neon(vmovl_s16(vget_high_s16(v)))));
+    }
+#endif
+
+    for (; c < len; c++)
+	dst[c] += src[c] / 2;
+}
+
+
+/* Interleaves separate left and right 16-bit buffers of len frames into dst. */
+void
+sound_mix_add_int16_planar(int32_t *dst, const int16_t *l, const int16_t *r, int len)
+{
+    int c = 0;
+#if defined(__SSE2__)
+    __m128i vl, vr, lo, hi;
+
+    for (; c <= (len - 8); c += 8) {
+	vl = _mm_loadu_si128((__m128i *) &l[c]);
+	vr = _mm_loadu_si128((__m128i *) &r[c]);
+	lo = _mm_unpacklo_epi16(vl, vr);
+	hi = _mm_unpackhi_epi16(vl, vr);
+	_mm_storeu_si128((__m128i *) &dst[c * 2], _mm_add_epi32(_mm_loadu_si128((__m128i *) &dst[c * 2]),
+								_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)));
+	_mm_storeu_si128((__m128i *) &dst[c * 2 + 4], _mm_add_epi32(_mm_loadu_si128((__m128i *) &dst[c * 2 + 4]),
+								    _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)));
+	_mm_storeu_si128((__m128i *) &dst[c * 2 + 8], _mm_add_epi32(_mm_loadu_si128((__m128i *) &dst[c * 2 + 8]),
+								    _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)));
+	_mm_storeu_si128((__m128i *) &dst[c * 2 + 12], _mm_add_epi32(_mm_loadu_si128((__m128i *) &dst[c * 2 + 12]),
+								     _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)));
+    }
+#elif defined(__ARM_NEON)
+    int16x8x2_t z;
+
+    for (; c <= (len - 8); c += 8) {
+	z = vzipq_s16(vld1q_s16(&l[c]), vld1q_s16(&r[c]));
+	vst1q_s32(&dst[c * 2], vaddq_s32(vld1q_s32(&dst[c * 2]), vmovl_s16(vget_low_s16(z.val[0]))));
+	vst1q_s32(&dst[c * 2 + 4], vaddq_s32(vld1q_s32(&dst[c * 2 + 4]), vmovl_s16(vget_high_s16(z.val[0]))));
+	vst1q_s32(&dst[c * 2 + 8], vaddq_s32(vld1q_s32(&dst[c * 2 + 8]), vmovl_s16(vget_low_s16(z.val[1]))));
+	vst1q_s32(&dst[c * 2 + 12], vaddq_s32(vld1q_s32(&dst[c * 2 + 12]), vmovl_s16(vget_high_s16(z.val[1]))));
+    }
+#endif
+
+    for (; c < len; c++) {
+	dst[c * 2] += l[c];
+	dst[c * 2 + 1] += r[c];
+    }
+}
+
+
+/* Clamps to 16 bits. */
+void
+sound_mix_to_int16(int16_t *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+#if defined(__SSE2__)
+    for (; c <= (len - 8); c += 8)
+	_mm_storeu_si128((__m128i *) &dst[c], _mm_packs_epi32(_mm_loadu_si128((__m128i *) &src[c]),
+							      _mm_loadu_si128((__m128i *) &src[c + 4])));
+#elif defined(__ARM_NEON)
+    for (; c <= (len - 8); c += 8)
+	vst1q_s16(&dst[c], vcombine_s16(vqmovn_s32(vld1q_s32(&src[c])), vqmovn_s32(vld1q_s32(&src[c + 4]))));
+#endif
+
+    for (; c < len; c++) {
+	if (src[c] > 32767)
+		dst[c] = 32767;
+	else if (src[c] < -32768)
+		dst[c] = -32768;
+	else
+		dst[c] = src[c];
+    }
+}
+
+
+/* Scales to -1.0 .. 1.0 for 16-bit full scale; the scale is a power of
+   two, so multiplying gives the same result as dividing. */
+void
+sound_mix_to_float(float *dst, const int32_t *src, int len)
+{
+    int c = 0;
+
+#if defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+    for (; c <= (len - 4); c += 4)
+	_mm_storeu_ps(&dst[c], _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((__m128i *) &src[c])), scale));
+#elif defined(__ARM_NEON)
+    for (; c <= (len - 4); c += 4)
+	vst1q_f32(&dst[c], vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(&src[c])), 1.0f / 32768.0f));
+#endif
+
+    for (; c < len; c++)
+	dst[c] = ((float) src[c]) / 32768.0f;
+}
+
+
+/* Convert a mixed period to the output format and hand it to OpenAL. */
+static void
+sound_output(int32_t *buffer)
+{
+    if (sound_is_float) {
+	sound_mix_to_float(outbuffer_ex, buffer, SOUNDBUFLEN * 2);
+	givealbuffer(outbuffer_ex);
+    } else {
+	sound_mix_to_int16(outbuffer_ex_int16, buffer, SOUNDBUFLEN * 2);
+	givealbuffer(outbuffer_ex_int16);
+    }
+}
+
+
+/* Converts and submits the periods mixed by sound_poll(), so the
+   emulation thread never waits on OpenAL. */
+static void
+sound_thread(void *param)
+{
+    int32_t *buffer;
+
+    while (soundon) {
+	thread_wait_event(sound_event, -1);
+	thread_reset_event(sound_event);
+
+	if (!soundon)
+		return;
+
+	while ((buffer = (int32_t *) ringbuf_read_ptr(&sound_ring)) != NULL) {
+		sound_output(buffer);
+		ringbuf_read_commit(&sound_ring);
+	}
+    }
+}
+
+
+static void
+sound_thread_start(void)
+{
+    if (sound_sync || soundon)
+	return;
+
+    if (! ringbuf_init(&sound_ring, SOUNDBUFLEN * 2 * sizeof(int32_t), SOUND_RING))
+	return;
+
+    soundon = 1;
+    sound_event = thread_create_event();
+    sound_thread_h = thread_create(sound_thread, NULL);
+}
+
+
+void
+sound_thread_end(void)
+{
+    if (soundon) {
+	soundon = 0;
+
+	sound_log("Waiting for audio thread to terminate...\n");
+	thread_set_event(sound_event);
+	thread_wait(sound_thread_h, -1);
+	sound_log("Audio thread terminated, %i periods dropped\n", sound_dropped);
+
+	thread_destroy_event(sound_event);
+	sound_event = NULL;
+	sound_thread_h = NULL;
+
+	ringbuf_close(&sound_ring);
+	sound_dropped = 0;
+    }
+}
+
+
 void
 sound_poll(void *priv)
 {
+    int32_t *buffer = outbuffer;
+    int c;
+
     timer_advance_u64(&sound_poll_timer, sound_poll_latch);
 
     midi_poll();
 
     sound_pos_global++;
     if (sound_pos_global == SOUNDBUFLEN) {
-	int c;
+	/* Mix straight into the audio thread's ring; if it has fallen a whole
+	   ring behind, mix into the local buffer and drop the period, just
+	   like OpenAL does when it has no free buffer. */
+	if (soundon) {
+		buffer = (int32_t *) ringbuf_write_ptr(&sound_ring);
+		if (buffer == NULL) {
+			sound_dropped++;
+			buffer = outbuffer;
+		}
+	}
 
-	memset(outbuffer, 0, SOUNDBUFLEN * 2 * sizeof(int32_t));
+	memset(buffer, 0, SOUNDBUFLEN * 2 * sizeof(int32_t));
 
 	for (c = 0; c < sound_handlers_num; c++)
-		sound_handlers[c].get_buffer(outbuffer, SOUNDBUFLEN, sound_handlers[c].priv);
-
-	for (c = 0; c < SOUNDBUFLEN * 2; c++) {
-		if (sound_is_float)
-			outbuffer_ex[c] = ((float) outbuffer[c]) / 32768.0;
-		else {
-			if (outbuffer[c] > 32767)
-				outbuffer[c] = 32767;
-			if (outbuffer[c] < -32768)
-				outbuffer[c] = -32768;
-
-			outbuffer_ex_int16[c] = outbuffer[c];
-		}
-	}
+		sound_handlers[c].get_buffer(buffer, SOUNDBUFLEN, sound_handlers[c].priv);
 
-	if (sound_is_float)
-		givealbuffer(outbuffer_ex);
-	else
-		givealbuffer(outbuffer_ex_int16);
+	if (sound_capture)
+		sound_capture_write(SOUND_CAPTURE_MIX, SOUND_CAPTURE_INT32, buffer, SOUNDBUFLEN, 48000);
+
+	if (!soundon)
+		sound_output(buffer);
+	else if (buffer != outbuffer) {
+		ringbuf_write_commit(&sound_ring);
+		thread_set_event(sound_event);
+	}
 
 	if (cd_thread_enable) {
                 cd_buf_update--;
        	        if (!cd_buf_update) {
        	                cd_buf_update = (48000 / SOUNDBUFLEN) / (CD_FREQ / CD_BUFLEN);
+				if (cd_busy)
+					cd_late++;
                	        thread_set_event(sound_cd_event);
                 }
 	}
@@ -450,12 +769,16 @@ sound_speed_changed(void)
 void
 sound_reset(void)
 {
+    sound_thread_end();
+
     sound_realloc_buffers();
 
     midi_device_init();
     midi_in_device_init();
     inital();
 
+    sound_thread_start();
+
     timer_add(&sound_poll_timer, sound_poll, NULL, 1);
 
     sound_handlers_num = 0;
@@ -501,6 +824,19 @@ sound_cd_thread_end(void)
 	thread_wait(sound_cd_thread_h, -1);
 	sound_log("CD Audio thread terminated...\n");
 
+	thread_set_event(sound_cd_read_event);
+	thread_wait(sound_cd_read_thread_h, -1);
+	sound_cd_read_thread_h = NULL;
+
+	if (sound_cd_read_event) {
+		thread_destroy_event(sound_cd_read_event);
+		sound_cd_read_event = NULL;
+	}
+
+	if (cd_late)
+		sound_log("CD Audio thread was late %i times\n", cd_late);
+	cd_late = 0;
+
 	if (sound_cd_event) {
 		thread_destroy_event(sound_cd_event);
 		sound_cd_event = NULL;
@@ -512,6 +848,9 @@ sound_cd_thread_end(void)
 		thread_destroy_event(sound_cd_start_event);
 		sound_cd_event = NULL;
 	}
+
+	/* Have sound_cd_thread_reset() start them again. */
+	cd_thread_enable = 0;
     }
 }
 
@@ -539,6 +878,9 @@ sound_cd_thread_reset(void)
 
 	thread_wait_event(sound_cd_start_event, -1);
 	thread_reset_event(sound_cd_start_event);
+
+	sound_cd_read_event = thread_create_event();
+	sound_cd_read_thread_h = thread_create(sound_cd_read_thread, NULL);
     } else if (!available_cdrom_drives && cd_thread_enable)
 	sound_cd_thread_end();
 
@@ -2058,7 +2058,8 @@ static void network_recalc_combos(HWND hdlg)
     EnableWindow(h, (temp_net_type == NET_TYPE_PCAP) ? TRUE : FALSE);
 
     h = GetDlgItem(hdlg, IDC_COMBO_NET);
-    if (temp_net_type == NET_TYPE_SLIRP)
+    if ((temp_net_type == NET_TYPE_SLIRP) || (temp_net_type == NET_TYPE_VLAN) ||
+	(temp_net_type == NET_TYPE_REFLECT))
 	EnableWindow(h, TRUE);
     else if ((temp_net_type == NET_TYPE_PCAP) &&
 	     (network_dev_to_id(temp_pcap_dev) > 0))
@@ -2068,7 +2069,8 @@ static void network_recalc_combos(HWND hdlg)
 
     h = GetDlgItem(hdlg, IDC_CONFIGURE_NET);
     if (network_card_has_config(temp_net_card) &&
-	(temp_net_type == NET_TYPE_SLIRP))
+	((temp_net_type == NET_TYPE_SLIRP) || (temp_net_type == NET_TYPE_VLAN) ||
+	(temp_net_type == NET_TYPE_REFLECT)))
 	EnableWindow(h, TRUE);
     else if (network_card_has_config(temp_net_card) &&
 	     (temp_net_type == NET_TYPE_PCAP) &&
@@ -2101,6 +2103,8 @@ win_settings_network_proc(HWND hdlg, UINT message, WPARAM wParam, LPARAM lParam)
 		SendMessage(h, CB_ADDSTRING, 0, (LPARAM) L"None");
 		SendMessage(h, CB_ADDSTRING, 0, (LPARAM) L"PCap");
 		SendMessage(h, CB_ADDSTRING, 0, (LPARAM) L"SLiRP");
+		SendMessage(h, CB_ADDSTRING, 0, (LPARAM) L"Local VLAN");
+		SendMessage(h, CB_ADDSTRING, 0, (LPARAM) L"Reflector (benchmark)");
 		SendMessage(h, CB_SETCURSEL, temp_net_type, 0);
 
 		h = GetDlgItem(hdlg, IDC_COMBO_PCAP);
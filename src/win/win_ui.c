@@ -33,6 +33,7 @@
 #include <86box/device.h>
 #include <86box/keyboard.h>
 #include <86box/mouse.h>
+#include <86box/network.h>
 #include <86box/video.h>
 #include <86box/vid_ega.h>		// for update_overscan
 #include <86box/plat.h>
@@ -182,6 +183,8 @@ ResetAllMenus(void)
 
     CheckMenuItem(menuMain, IDM_UPDATE_ICONS, MF_UNCHECKED);
 
+    CheckMenuItem(menuMain, IDM_NET_CAPTURE, MF_UNCHECKED);
+
 #ifdef ENABLE_LOG_TOGGLES
 # ifdef ENABLE_BUSLOGIC_LOG
     CheckMenuItem(menuMain, IDM_LOG_BUSLOGIC, MF_UNCHECKED);
@@ -242,6 +245,8 @@ ResetAllMenus(void)
 
     CheckMenuItem(menuMain, IDM_UPDATE_ICONS, update_icons ? MF_CHECKED : MF_UNCHECKED);
 
+    CheckMenuItem(menuMain, IDM_NET_CAPTURE, network_capture ? MF_CHECKED : MF_UNCHECKED);
+
 #ifdef ENABLE_LOG_TOGGLES
 # ifdef ENABLE_BUSLOGIC_LOG
     CheckMenuItem(menuMain, IDM_LOG_BUSLOGIC, buslogic_do_log?MF_CHECKED:MF_UNCHECKED);
@@ -446,6 +451,15 @@ MainWindowProcedure(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 				config_save();
 				break;
 
+			case IDM_NET_CAPTURE:
+				/* Hold the emulation thread between frames while the capture file changes. */
+				startblit();
+				network_capture_enable(network_capture ^ 1);
+				endblit();
+				CheckMenuItem(hmenu, IDM_NET_CAPTURE, network_capture ? MF_CHECKED : MF_UNCHECKED);
+				config_save();
+				break;
+
 			case IDM_VID_RESIZE:
 				vid_resize = !vid_resize;
 				CheckMenuItem(hmenu, IDM_VID_RESIZE, (vid_resize)? MF_CHECKED : MF_UNCHECKED);